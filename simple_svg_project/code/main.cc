@@ -0,0 +1,53 @@
+/**
+ *\file main.cc
+ *\brief simple_svg 的演示程序
+ *\date 2017/07/17
+ */
+#include <stdio.h>
+#include <libxml/tree.h>
+#include <libxml/parser.h>
+
+#include "simple_svg.h"
+
+int main(void)
+{
+	st_svg_handler handler;
+	st_svg_position position = {0, 0, 800, 800, 0, 0, 800, 800};
+	xmlNodePtr p_node;
+	xmlNodePtr tmp_node;
+	int  ret = 0;
+
+	if (SVG_SUCCESS != init_svg_handler(&handler)){
+
+		printf("init svg handler failed\n");
+		return -1;
+	}
+	set_svg_position(&handler, &position);
+	p_node = handler.root_node;
+
+	tmp_node = xmlNewTextChild(p_node, NULL, BAD_CAST"text", BAD_CAST"test hello!");
+	xmlNewProp(tmp_node, BAD_CAST"y", BAD_CAST"100");
+	xmlNewProp(tmp_node, BAD_CAST"x", BAD_CAST"100");
+
+	/* 创建 svg */
+	tmp_node = xmlNewDocNode(handler.xml_doc, NULL, BAD_CAST"svg", NULL);
+	xmlNewProp(tmp_node, BAD_CAST"x", BAD_CAST"0");
+	xmlNewProp(tmp_node, BAD_CAST"y", BAD_CAST"0");
+	xmlNewProp(tmp_node, BAD_CAST"width", BAD_CAST"200");
+	xmlNewProp(tmp_node, BAD_CAST"height", BAD_CAST"200");
+	xmlNewProp(tmp_node, BAD_CAST"viewBox", BAD_CAST"0 0 200 200");
+	xmlAddChild(p_node, tmp_node);
+	tmp_node = xmlNewTextChild(tmp_node, NULL, BAD_CAST"line", NULL);
+	xmlNewProp(tmp_node, BAD_CAST"x1", BAD_CAST"10");
+	xmlNewProp(tmp_node, BAD_CAST"y1", BAD_CAST"10");
+	xmlNewProp(tmp_node, BAD_CAST"x2", BAD_CAST"50");
+	xmlNewProp(tmp_node, BAD_CAST"y2", BAD_CAST"90");
+	xmlNewProp(tmp_node, BAD_CAST"style", BAD_CAST"stroke: red; fill: none;");
+
+	ret = xmlSaveFile("test.svg", handler.xml_doc);
+	printf("ret = %d\n", ret);
+
+	destroy_svg_handler(&handler);
+
+	return 0;
+}
@@ -4,53 +4,744 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <libxml/tree.h>
+#include <libxml/dict.h>
+#include <libxml/hash.h>
+#include <libxml/xmlIO.h>
 #include <libxml/parser.h>
 #include <libxml/xinclude.h>
 #include <libxml/xmlstring.h>
 
-int main(void)
+#include "simple_svg.h"
+
+static pthread_once_t svg_init_once = PTHREAD_ONCE_INIT;	///< libxml2 全局初始化标记
+static pthread_once_t svg_key_once = PTHREAD_ONCE_INIT;		///< 线程私有句柄池 key 的创建标记
+static pthread_key_t svg_pool_key;	///< 线程私有句柄池
+
+/**
+ *\brief pthread_once 回调，初始化 libxml2
+ */
+static void svg_global_init_once(void)
 {
-	xmlDocPtr p_doc;
-	xmlNodePtr p_node;
-	xmlNodePtr tmp_node;
-	int  ret = 0;
-	
-	p_doc = xmlNewDoc(BAD_CAST"1.0");
-	p_node = xmlNewNode(NULL, BAD_CAST"svg");
-
-	xmlNewProp(p_node, BAD_CAST"y", BAD_CAST"0");
-	xmlNewProp(p_node, BAD_CAST"x", BAD_CAST"0");
-	xmlNewProp(p_node, BAD_CAST"width", BAD_CAST"800");
-	xmlNewProp(p_node, BAD_CAST"height", BAD_CAST"800");
-	xmlNewProp(p_node, BAD_CAST"viewBox", BAD_CAST"0 0 800 800");
-	xmlNewProp(p_node, BAD_CAST"xmlns", BAD_CAST"http://www.w3.org/2000/svg");
-	xmlNewProp(p_node, BAD_CAST"xmlns:xlink", BAD_CAST"http://www.w3.org/1999/xlink");
-	xmlNewProp(p_node, BAD_CAST"version", BAD_CAST"1.1");
-	
-	xmlDocSetRootElement(p_doc, p_node);
-	
-	tmp_node = xmlNewTextChild(p_node, NULL, BAD_CAST"text", BAD_CAST"test hello!");
-	xmlNewProp(tmp_node, BAD_CAST"y", BAD_CAST"100");
-	xmlNewProp(tmp_node, BAD_CAST"x", BAD_CAST"100");
-	
-	/* 创建 svg */
-	tmp_node = xmlNewNode(NULL, BAD_CAST"svg");
-	xmlNewProp(tmp_node, BAD_CAST"x", BAD_CAST"0");
-	xmlNewProp(tmp_node, BAD_CAST"y", BAD_CAST"0");
-	xmlNewProp(tmp_node, BAD_CAST"width", BAD_CAST"200");
-	xmlNewProp(tmp_node, BAD_CAST"height", BAD_CAST"200");
-	xmlNewProp(tmp_node, BAD_CAST"viewBox", BAD_CAST"0 0 200 200");
-	xmlAddChild(p_node, tmp_node);
-	tmp_node = xmlNewTextChild(tmp_node, NULL, BAD_CAST"line", NULL);
-	xmlNewProp(tmp_node, BAD_CAST"x1", BAD_CAST"10");
-	xmlNewProp(tmp_node, BAD_CAST"y1", BAD_CAST"10");
-	xmlNewProp(tmp_node, BAD_CAST"x2", BAD_CAST"50");
-	xmlNewProp(tmp_node, BAD_CAST"y2", BAD_CAST"90");
-	xmlNewProp(tmp_node, BAD_CAST"style", BAD_CAST"stroke: red; fill: none;");
-	
-	ret = xmlSaveFile("test.svg", p_doc);
-	printf("ret = %d\n", ret);
+	xmlInitParser();
+}
+
+/**
+ *\brief 线程退出时销毁线程私有句柄池
+ */
+static void svg_thread_pool_free(void *data)
+{
+	st_svg_handler_pool *pool = (st_svg_handler_pool *)data;
+
+	destroy_svg_handler_pool(pool);
+	free(pool);
+}
+
+/**
+ *\brief pthread_once 回调，创建线程私有句柄池的 key
+ */
+static void svg_pool_key_once(void)
+{
+	pthread_key_create(&svg_pool_key, svg_thread_pool_free);
+}
+
+/**
+ *\brief 创建 init 时的 <svg> 根节点，替换并释放文档原有的根节点
+ *\param[in,out] handler 操作svg图片的句柄，xml_doc 已创建
+ *\retval SVG_SUCCESS 成功
+ *\retval SVG_FAILED 内存不足，原有根节点保留
+ */
+static int svg_handler_root(st_svg_handler *handler)
+{
+	xmlNodePtr root;
+	xmlNodePtr old_root;
+
+	/* 必须用 xmlNewDocNode，节点名、属性名才会经过 doc->dict 驻留 */
+	root = xmlNewDocNode(handler->xml_doc, NULL, BAD_CAST"svg", NULL);
+	if (NULL == root){
+
+		return SVG_FAILED;
+	}
+	xmlNewProp(root, BAD_CAST"xmlns", BAD_CAST"http://www.w3.org/2000/svg");
+	xmlNewProp(root, BAD_CAST"xmlns:xlink", BAD_CAST"http://www.w3.org/1999/xlink");
+	xmlNewProp(root, BAD_CAST"version", BAD_CAST"1.1");
+
+	old_root = xmlDocSetRootElement(handler->xml_doc, root);
+	if (NULL != old_root){
+
+		xmlFreeNode(old_root);
+	}
+	handler->root_node = root;
+
+	return SVG_SUCCESS;
+}
+
+/**
+ *\brief 创建xml文档和 <svg> 根节点，并挂上字符串字典
+ *\param[in,out] handler 操作svg图片的句柄
+ *\param[in] dict 共享的字符串字典，文档会持有它的一个引用
+ *\retval SVG_SUCCESS 成功
+ *\retval SVG_FAILED 失败
+ */
+static int svg_handler_setup(st_svg_handler *handler, xmlDictPtr dict)
+{
+	handler->id_index = NULL;
+	handler->xml_doc = xmlNewDoc(BAD_CAST"1.0");
+	if (NULL == handler->xml_doc){
+
+		handler->status = SVG_HANDLE_INVALID;
+		return SVG_FAILED;
+	}
+
+	/* 文档释放时会 xmlDictFree 一次，这里先加引用 */
+	handler->xml_doc->dict = dict;
+	xmlDictReference(dict);
+
+	if (SVG_SUCCESS != svg_handler_root(handler)){
+
+		xmlFreeDoc(handler->xml_doc);
+		handler->xml_doc = NULL;
+		handler->root_node = NULL;
+		handler->status = SVG_HANDLE_INVALID;
+		return SVG_FAILED;
+	}
+
+	handler->status = SVG_HANDLE_VALID;
+	return SVG_SUCCESS;
+}
+
+int svg_global_init(void)
+{
+	pthread_once(&svg_init_once, svg_global_init_once);
+
+	return SVG_SUCCESS;
+}
+
+st_svg_handler_pool *svg_thread_handler_pool(void)
+{
+	st_svg_handler_pool *pool;
+
+	pthread_once(&svg_key_once, svg_pool_key_once);
+
+	pool = (st_svg_handler_pool *)pthread_getspecific(svg_pool_key);
+	if (NULL != pool){
+
+		return pool;
+	}
+
+	pool = (st_svg_handler_pool *)malloc(sizeof(st_svg_handler_pool));
+	if (NULL == pool){
+
+		return NULL;
+	}
+	if (SVG_SUCCESS != init_svg_handler_pool(pool, SVG_THREAD_POOL_SIZE)){
+
+		free(pool);
+		return NULL;
+	}
+	if (0 != pthread_setspecific(svg_pool_key, pool)){
+
+		svg_thread_pool_free(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+int init_svg_handler(st_svg_handler *handler)
+{
+	xmlDictPtr dict;
+	int ret;
+
+	if (NULL == handler){
+
+		return SVG_FAILED;
+	}
+	svg_global_init();
+
+	dict = xmlDictCreate();
+	if (NULL == dict){
+
+		handler->status = SVG_HANDLE_INVALID;
+		return SVG_FAILED;
+	}
+	ret = svg_handler_setup(handler, dict);
+	xmlDictFree(dict);	/* 此后由文档独占 */
+
+	return ret;
+}
+
+int destroy_svg_handler(st_svg_handler *handler)
+{
+	if (NULL == handler || SVG_HANDLE_VALID != handler->status){
+
+		return SVG_FAILED;
+	}
+
+	if (NULL != handler->id_index){
+
+		xmlHashFree(handler->id_index, NULL);
+		handler->id_index = NULL;
+	}
+	xmlFreeDoc(handler->xml_doc);
+	handler->xml_doc = NULL;
+	handler->root_node = NULL;
+	handler->status = SVG_HANDLE_INVALID;
+
+	return SVG_SUCCESS;
+}
+
+int reset_svg_handler(st_svg_handler *handler)
+{
+	if (NULL == handler || SVG_HANDLE_VALID != handler->status){
+
+		return SVG_FAILED;
+	}
+
+	/* 有索引说明根节点来自模板，换回 init 时的 <svg> 根节点，模板的属性、命名空间一并丢弃 */
+	if (NULL != handler->id_index){
+
+		xmlHashFree(handler->id_index, NULL);
+		handler->id_index = NULL;
+		return svg_handler_root(handler);
+	}
+	xmlFreeNodeList(handler->root_node->children);
+	handler->root_node->children = NULL;
+	handler->root_node->last = NULL;
+
+	return SVG_SUCCESS;
+}
+
+int set_svg_position(st_svg_handler *handler, const st_svg_position *position)
+{
+	char buf[64];
+
+	if (NULL == handler || NULL == position || SVG_HANDLE_VALID != handler->status){
+
+		return SVG_FAILED;
+	}
+
+	/* xmlSetProp 会复用已有属性，reset 之后反复设置不会新增节点 */
+	snprintf(buf, sizeof(buf), "%u", position->x_viewport);
+	xmlSetProp(handler->root_node, BAD_CAST"x", BAD_CAST buf);
+	snprintf(buf, sizeof(buf), "%u", position->y_viewport);
+	xmlSetProp(handler->root_node, BAD_CAST"y", BAD_CAST buf);
+	snprintf(buf, sizeof(buf), "%u", position->width_viewport);
+	xmlSetProp(handler->root_node, BAD_CAST"width", BAD_CAST buf);
+	snprintf(buf, sizeof(buf), "%u", position->height_viewport);
+	xmlSetProp(handler->root_node, BAD_CAST"height", BAD_CAST buf);
+	snprintf(buf, sizeof(buf), "%u %u %u %u", position->x_viewbox, position->y_viewbox,
+		position->width_viewbox, position->height_viewbox);
+	xmlSetProp(handler->root_node, BAD_CAST"viewBox", BAD_CAST buf);
+
+	return SVG_SUCCESS;
+}
+
+int init_svg_handler_pool(st_svg_handler_pool *pool, unsigned int capacity)
+{
+	unsigned int i;
+
+	if (NULL == pool || 0 == capacity){
+
+		return SVG_FAILED;
+	}
+	memset(pool, 0, sizeof(*pool));
+	svg_global_init();
+
+	pool->xml_dict = xmlDictCreate();
+	pool->handlers = (st_svg_handler *)calloc(capacity, sizeof(st_svg_handler));
+	pool->free_list = (st_svg_handler **)calloc(capacity, sizeof(st_svg_handler *));
+	pool->in_use = (unsigned char *)calloc(capacity, sizeof(unsigned char));
+	if (NULL == pool->xml_dict || NULL == pool->handlers || NULL == pool->free_list
+		|| NULL == pool->in_use){
+
+		destroy_svg_handler_pool(pool);
+		return SVG_FAILED;
+	}
+
+	for (i = 0; i < capacity; i++){
+
+		if (SVG_SUCCESS != svg_handler_setup(&pool->handlers[i], pool->xml_dict)){
+
+			destroy_svg_handler_pool(pool);
+			return SVG_FAILED;
+		}
+		pool->capacity++;
+		pool->free_list[pool->free_count++] = &pool->handlers[i];
+	}
+
+	return SVG_SUCCESS;
+}
+
+int destroy_svg_handler_pool(st_svg_handler_pool *pool)
+{
+	unsigned int i;
+
+	if (NULL == pool){
+
+		return SVG_FAILED;
+	}
+
+	for (i = 0; i < pool->capacity; i++){
+
+		destroy_svg_handler(&pool->handlers[i]);
+	}
+	if (NULL != pool->xml_dict){
+
+		xmlDictFree(pool->xml_dict);
+	}
+	free(pool->handlers);
+	free(pool->free_list);
+	free(pool->in_use);
+	memset(pool, 0, sizeof(*pool));
+
+	return SVG_SUCCESS;
+}
+
+st_svg_handler *acquire_svg_handler(st_svg_handler_pool *pool)
+{
+	st_svg_handler *handler;
+
+	if (NULL == pool || 0 == pool->free_count){
+
+		return NULL;
+	}
+
+	handler = pool->free_list[--pool->free_count];
+	pool->in_use[handler - pool->handlers] = 1;
+
+	return handler;
+}
+
+int release_svg_handler(st_svg_handler_pool *pool, st_svg_handler *handler)
+{
+	if (NULL == pool || NULL == handler
+		|| handler < pool->handlers || handler >= pool->handlers + pool->capacity
+		|| !pool->in_use[handler - pool->handlers]){
+
+		return SVG_FAILED;
+	}
+
+	if (SVG_SUCCESS != reset_svg_handler(handler)){
+
+		return SVG_FAILED;
+	}
+	pool->in_use[handler - pool->handlers] = 0;
+	pool->free_list[pool->free_count++] = handler;
+
+	return SVG_SUCCESS;
+}
+
+/**
+ *\brief 遍历 root 及其所有后代元素，按 id 属性加入或移出索引
+ *
+ *	加入时 id 重复以先遇到的为准；移出时只删除仍指向该节点的项
+ *
+ *\param[in,out] index id -> 节点 索引
+ *\param[in] root 子树的根，不会访问它的兄弟节点
+ *\param[in] add 非 0 加入，0 移出
+ */
+static void svg_handler_index(xmlHashTablePtr index, xmlNodePtr root, int add)
+{
+	xmlNodePtr node = root;
+	xmlChar *id;
+
+	while (NULL != node){
+
+		if (XML_ELEMENT_NODE == node->type){
+
+			id = xmlGetProp(node, BAD_CAST"id");
+			if (NULL != id){
+
+				if (add){
+
+					xmlHashAddEntry(index, id, node);
+				}
+				else if (node == xmlHashLookup(index, id)){
+
+					xmlHashRemoveEntry(index, id, NULL);
+				}
+				xmlFree(id);
+			}
+			if (NULL != node->children){
+
+				node = node->children;
+				continue;
+			}
+		}
+
+		while (node != root && NULL == node->next){
+
+			node = node->parent;
+		}
+		if (node == root){
+
+			break;
+		}
+		node = node->next;
+	}
+}
+
+/**
+ *\brief 在克隆文档的 id 索引中定位节点
+ *\return 节点指针，找不到时返回 NULL
+ */
+static xmlNodePtr svg_template_lookup(const st_svg_template *tpl, st_svg_handler *handler, const char *id)
+{
+	if (NULL == tpl || NULL == handler || NULL == id
+		|| SVG_HANDLE_VALID != tpl->status || SVG_HANDLE_VALID != handler->status
+		|| NULL == handler->id_index){
+
+		return NULL;
+	}
+
+	return (xmlNodePtr)xmlHashLookup(handler->id_index, BAD_CAST id);
+}
+
+int load_svg_template(st_svg_template *tpl, const char *path)
+{
+	if (NULL == tpl || NULL == path){
+
+		return SVG_FAILED;
+	}
+	memset(tpl, 0, sizeof(*tpl));
+	tpl->status = SVG_HANDLE_INVALID;
+	svg_global_init();
+
+	/* 去掉缩进产生的空白文本节点，克隆时少复制一些节点 */
+	tpl->xml_doc = xmlReadFile(path, NULL, XML_PARSE_NOBLANKS | XML_PARSE_NONET);
+	if (NULL == tpl->xml_doc || NULL == xmlDocGetRootElement(tpl->xml_doc)){
+
+		destroy_svg_template(tpl);
+		return SVG_FAILED;
+	}
+
+	tpl->status = SVG_HANDLE_VALID;
+	return SVG_SUCCESS;
+}
+
+int destroy_svg_template(st_svg_template *tpl)
+{
+	if (NULL == tpl){
+
+		return SVG_FAILED;
+	}
+
+	if (NULL != tpl->xml_doc){
+
+		xmlFreeDoc(tpl->xml_doc);
+	}
+	memset(tpl, 0, sizeof(*tpl));
+	tpl->status = SVG_HANDLE_INVALID;
+
+	return SVG_SUCCESS;
+}
+
+int clone_svg_template(const st_svg_template *tpl, st_svg_handler *handler)
+{
+	xmlHashTablePtr index;
+	xmlNodePtr root;
+	xmlNodePtr old_root;
+
+	if (NULL == tpl || NULL == handler
+		|| SVG_HANDLE_VALID != tpl->status || SVG_HANDLE_VALID != handler->status){
+
+		return SVG_FAILED;
+	}
+
+	/* 先分配好索引和节点，失败时句柄保持原样；根节点被替换时索引必定存在 */
+	index = xmlHashCreate(64);
+	if (NULL == index){
+
+		return SVG_FAILED;
+	}
+	/* 复制到句柄的文档中，名字会在句柄的 xmlDict 中驻留 */
+	root = xmlDocCopyNode(xmlDocGetRootElement(tpl->xml_doc), handler->xml_doc, 1);
+	if (NULL == root){
+
+		xmlHashFree(index, NULL);
+		return SVG_FAILED;
+	}
+
+	old_root = xmlDocSetRootElement(handler->xml_doc, root);
+	if (NULL != old_root){
+
+		xmlFreeNode(old_root);
+	}
+	handler->root_node = root;
+
+	/* 索引建在克隆出的节点上，修补时直接定位，不依赖文档结构 */
+	if (NULL != handler->id_index){
+
+		xmlHashFree(handler->id_index, NULL);
+	}
+	handler->id_index = index;
+	svg_handler_index(handler->id_index, root, 1);
+
+	return SVG_SUCCESS;
+}
+
+int patch_svg_attr(const st_svg_template *tpl, st_svg_handler *handler,
+	const char *id, const char *name, const char *value)
+{
+	xmlNodePtr node;
+	xmlAttrPtr attr;
+	int is_id;
+
+	node = svg_template_lookup(tpl, handler, id);
+	if (NULL == node || NULL == name){
+
+		return SVG_FAILED;
+	}
+
+	/* 修改 id 本身时同步更新索引 */
+	is_id = (0 == strcmp(name, "id"));
+	if (is_id){
+
+		xmlHashRemoveEntry(handler->id_index, BAD_CAST id, NULL);
+	}
+	attr = xmlSetProp(node, BAD_CAST name, BAD_CAST value);
+	if (is_id && NULL != attr && NULL != value){
+
+		xmlHashAddEntry(handler->id_index, BAD_CAST value, node);
+	}
+	if (NULL == attr){
+
+		return SVG_FAILED;
+	}
+
+	return SVG_SUCCESS;
+}
+
+int patch_svg_text(const st_svg_template *tpl, st_svg_handler *handler,
+	const char *id, const char *content)
+{
+	xmlNodePtr node;
+	xmlNodePtr child;
+
+	node = svg_template_lookup(tpl, handler, id);
+	if (NULL == node){
+
+		return SVG_FAILED;
+	}
+
+	/* 子节点即将被释放，先把其中带 id 的元素移出索引 */
+	for (child = node->children; NULL != child; child = child->next){
+
+		svg_handler_index(handler->id_index, child, 0);
+	}
+
+	/* xmlNodeSetContent 会把内容当作已转义的文本解析，这里先清空再追加原始文本 */
+	xmlNodeSetContent(node, NULL);
+	if (NULL != content){
+
+		xmlNodeAddContent(node, BAD_CAST content);
+	}
+
+	return SVG_SUCCESS;
+}
+
+/**
+ *\struct st_svg_fd_writer
+ *\brief save_svg_to_fd 的输出上下文
+ */
+typedef struct svg_fd_writer{
 	
+	int		fd;		///< 目标文件描述符
+	int		error;	///< write 出错时置 1
+	size_t	used;	///< chunk 中已有的字节数
+	char	*chunk;	///< 大小为 SVG_WRITE_CHUNK 的暂存区
+}st_svg_fd_writer;
+
+/**
+ *\brief 把 data 全部写入 fd，处理 EINTR 和部分写
+ *\retval SVG_SUCCESS 成功
+ *\retval SVG_FAILED 出错
+ */
+static int svg_write_full(int fd, const char *data, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0){
+
+		n = write(fd, data, len);
+		if (n < 0){
+
+			if (EINTR == errno){
+
+				continue;
+			}
+			return SVG_FAILED;
+		}
+		data += n;
+		len -= n;
+	}
+
+	return SVG_SUCCESS;
+}
+
+/**
+ *\brief xmlOutputBuffer 的写回调，追加到 st_svg_buffer
+ *\return 写入的字节数，-1 表示内存不足
+ */
+static int svg_buffer_write(void *context, const char *data, int len)
+{
+	st_svg_buffer *buffer = (st_svg_buffer *)context;
+	size_t capacity;
+	char *p;
+
+	if (buffer->size + len > buffer->capacity){
+
+		capacity = buffer->capacity ? buffer->capacity : SVG_WRITE_CHUNK;
+		while (capacity < buffer->size + len){
+
+			capacity *= 2;
+		}
+		p = (char *)realloc(buffer->data, capacity);
+		if (NULL == p){
+
+			return -1;
+		}
+		buffer->data = p;
+		buffer->capacity = capacity;
+	}
+	memcpy(buffer->data + buffer->size, data, len);
+	buffer->size += len;
+
+	return len;
+}
+
+/**
+ *\brief xmlOutputBuffer 的写回调，攒满 SVG_WRITE_CHUNK 再写入 fd
+ *\return 写入的字节数，-1 表示 write 出错
+ */
+static int svg_fd_write(void *context, const char *data, int len)
+{
+	st_svg_fd_writer *writer = (st_svg_fd_writer *)context;
+	size_t left = len;
+	size_t n;
+
+	while (left > 0){
+
+		n = SVG_WRITE_CHUNK - writer->used;
+		if (n > left){
+
+			n = left;
+		}
+		memcpy(writer->chunk + writer->used, data, n);
+		writer->used += n;
+		data += n;
+		left -= n;
+
+		if (SVG_WRITE_CHUNK == writer->used){
+
+			if (SVG_SUCCESS != svg_write_full(writer->fd, writer->chunk, writer->used)){
+
+				writer->error = 1;
+				return -1;
+			}
+			writer->used = 0;
+		}
+	}
+
+	return len;
+}
+
+/**
+ *\brief xmlOutputBuffer 的关闭回调，写出剩余数据，不关闭 fd
+ */
+static int svg_fd_close(void *context)
+{
+	st_svg_fd_writer *writer = (st_svg_fd_writer *)context;
+
+	if (!writer->error && writer->used > 0){
+
+		if (SVG_SUCCESS != svg_write_full(writer->fd, writer->chunk, writer->used)){
+
+			writer->error = 1;
+			return -1;
+		}
+		writer->used = 0;
+	}
+
 	return 0;
-}
\ No newline at end of file
+}
+
+int save_svg_to_buffer(st_svg_handler *handler, st_svg_buffer *buffer)
+{
+	xmlOutputBufferPtr out;
+
+	if (NULL == handler || NULL == buffer || SVG_HANDLE_VALID != handler->status){
+
+		return SVG_FAILED;
+	}
+
+	buffer->size = 0;
+	out = xmlOutputBufferCreateIO(svg_buffer_write, NULL, buffer, NULL);
+	if (NULL == out){
+
+		return SVG_FAILED;
+	}
+
+	/* xmlSaveFileTo 会关闭 out */
+	if (xmlSaveFileTo(out, handler->xml_doc, NULL) < 0){
+
+		return SVG_FAILED;
+	}
+
+	return SVG_SUCCESS;
+}
+
+void free_svg_buffer(st_svg_buffer *buffer)
+{
+	if (NULL == buffer){
+
+		return;
+	}
+
+	free(buffer->data);
+	buffer->data = NULL;
+	buffer->size = 0;
+	buffer->capacity = 0;
+}
+
+int save_svg_to_fd(st_svg_handler *handler, int fd)
+{
+	st_svg_fd_writer writer;
+	xmlOutputBufferPtr out;
+	int ret;
+
+	if (NULL == handler || fd < 0 || SVG_HANDLE_VALID != handler->status){
+
+		return SVG_FAILED;
+	}
+
+	writer.fd = fd;
+	writer.error = 0;
+	writer.used = 0;
+	writer.chunk = (char *)malloc(SVG_WRITE_CHUNK);
+	if (NULL == writer.chunk){
+
+		return SVG_FAILED;
+	}
+
+	out = xmlOutputBufferCreateIO(svg_fd_write, svg_fd_close, &writer, NULL);
+	if (NULL == out){
+
+		free(writer.chunk);
+		return SVG_FAILED;
+	}
+
+	ret = xmlSaveFileTo(out, handler->xml_doc, NULL);
+	free(writer.chunk);
+	if (ret < 0 || writer.error){
+
+		return SVG_FAILED;
+	}
+
+	return SVG_SUCCESS;
+}
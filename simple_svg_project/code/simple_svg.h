@@ -7,12 +7,23 @@
  *	2. 柱状分布图
  *	3. 流速状态图
  *
+ *	线程安全约定：
+ *	1. libxml2 的全局初始化由 svg_global_init 完成且只执行一次，各初始化接口会自动调用它
+ *	2. st_svg_handler、st_svg_handler_pool 不加锁，同一时刻只能被一个线程使用；
+ *	   工作线程应通过 svg_thread_handler_pool 取得本线程私有的句柄池
+ *	3. st_svg_template 加载完成后只读，可以被多个线程同时克隆
+ *
  *\date 2017/07/04
  */
 
 #ifndef __SIMPLE_SVG_H_2017_07_04__
 #define	__SIMPLE_SVG_H_2017_07_04__
 
+#include <stddef.h>
+#include <libxml/tree.h>
+#include <libxml/dict.h>
+#include <libxml/hash.h>
+
 /**
  *\enum SVG_STATUS
  *\brief SVG状态
@@ -48,9 +59,84 @@ typedef struct svg_position{
 typedef struct svg_handler{
 	
 	xmlDocPtr		xml_doc;	///< svg图片采用libxml2.0库操作， xml文档的指针
+	xmlNodePtr		root_node;	///< 文档的根节点 <svg>，reset 时保留
+	xmlHashTablePtr	id_index;	///< 克隆文档中 id -> 节点，clone 时建立，reset 时清空；非 NULL 表示根节点来自模板
 	unsigned int	status;		///< 表示当前引用的句柄状态
 }st_svg_handler;
 
+/**
+ *\struct st_svg_handler_pool
+ *\brief svg句柄池
+ *
+ *	池中所有句柄共享同一个 xmlDict，元素名、属性名（"svg"、"viewBox"、"x"、"y"、"line"、"style"等）
+ *	只需驻留一次；句柄归还时只清空根节点下的子节点，xmlDoc 和根节点本身被复用。
+ *
+ *\warning xmlDict 的查找没有加锁，一个句柄池只能在一个线程里使用
+ */
+typedef struct svg_handler_pool{
+	
+	xmlDictPtr		xml_dict;	///< 所有句柄共享的字符串字典
+	st_svg_handler	*handlers;	///< 句柄数组
+	st_svg_handler	**free_list;	///< 空闲句柄栈
+	unsigned char	*in_use;	///< 每个句柄是否已被取出，用于拒绝重复归还
+	unsigned int	capacity;	///< 句柄总数
+	unsigned int	free_count;	///< 空闲句柄数
+}st_svg_handler_pool;
+
+/**
+ *\struct st_svg_template
+ *\brief svg模板，解析一次后可反复克隆、修补
+ *
+ *	克隆时为克隆出的所有带 id 属性的元素建立 id -> 节点 的索引，存放在句柄中，
+ *	修补时直接按 id 定位节点，不需要遍历文档；修补文本删除的子元素会同时移出索引。
+ */
+typedef struct svg_template{
+	
+	xmlDocPtr		xml_doc;	///< 解析后的模板文档，只读
+	unsigned int	status;		///< 表示当前模板的状态
+}st_svg_template;
+
+/**
+ *\def SVG_THREAD_POOL_SIZE
+ *\brief 每个线程私有句柄池的句柄个数
+ */
+#define SVG_THREAD_POOL_SIZE	4
+
+/**
+ *\def SVG_WRITE_CHUNK
+ *\brief save_svg_to_fd 每次 write 的最小字节数（最后一次除外）
+ */
+#define SVG_WRITE_CHUNK		(64 * 1024)
+
+/**
+ *\struct st_svg_buffer
+ *\brief 保存svg的内存缓冲区，重复使用时保留已分配的空间
+ */
+typedef struct svg_buffer{
+	
+	char		*data;		///< 数据，不以 '\0' 结尾
+	size_t		size;		///< 数据长度
+	size_t		capacity;	///< 已分配的空间
+}st_svg_buffer;
+
+/**
+ *\brief libxml2 全局初始化（xmlInitParser），进程内只执行一次，可重复调用
+ *
+ *	多线程使用前最好先在主线程中调用一次
+ *
+ *\retval SVG_SUCCESS 成功
+ */
+int svg_global_init(void);
+
+/**
+ *\brief 取得当前线程私有的句柄池，首次调用时创建，线程退出时自动销毁
+ *
+ *	池中句柄共享的 xmlDict 只在本线程内使用，不需要加锁
+ *
+ *\return 句柄池，创建失败时返回 NULL
+ */
+st_svg_handler_pool *svg_thread_handler_pool(void);
+
 /**
  *\brief 初始化svg句柄
  *\param[in,out] handler 操作svg图片的句柄
@@ -67,6 +153,147 @@ int init_svg_handler(st_svg_handler *handler);
  */
 int destroy_svg_handler(st_svg_handler *handler);
 
+/**
+ *\brief 重置svg句柄，清空根节点下的所有图形
+ *
+ *	xmlDoc、根节点及其属性、xmlDict 均被保留，之后可以直接绘制下一张图片；
+ *	克隆过模板的句柄则换回 init 时的 <svg> 根节点，不保留模板根节点的属性
+ *
+ *\param[in,out] handler 操作svg图片的句柄
+ *\retval SVG_SUCCESS 重置成功
+ *\retval SVG_FAILED 句柄不可用
+ */
+int reset_svg_handler(st_svg_handler *handler);
+
+/**
+ *\brief 设置svg根节点的坐标和视图大小
+ *\param[in,out] handler 操作svg图片的句柄
+ *\param[in] position 坐标和视图大小
+ *\retval SVG_SUCCESS 设置成功
+ *\retval SVG_FAILED 设置失败
+ */
+int set_svg_position(st_svg_handler *handler, const st_svg_position *position);
+
+/**
+ *\brief 初始化svg句柄池
+ *\param[in,out] pool 句柄池
+ *\param[in] capacity 池中句柄个数
+ *\retval SVG_SUCCESS 初始化成功
+ *\retval SVG_FAILED 初始化失败
+ */
+int init_svg_handler_pool(st_svg_handler_pool *pool, unsigned int capacity);
+
+/**
+ *\brief 销毁svg句柄池，池中所有句柄一并销毁
+ *\param[in,out] pool 句柄池
+ *\retval SVG_SUCCESS 成功销毁
+ *\retval SVG_FAILED 销毁失败
+ */
+int destroy_svg_handler_pool(st_svg_handler_pool *pool);
+
+/**
+ *\brief 从句柄池中取出一个空闲句柄
+ *\param[in,out] pool 句柄池
+ *\return 空闲句柄，池已耗尽时返回 NULL
+ */
+st_svg_handler *acquire_svg_handler(st_svg_handler_pool *pool);
+
+/**
+ *\brief 将句柄归还句柄池，归还前会先 reset
+ *\param[in,out] pool 句柄池
+ *\param[in,out] handler 从该池取出的句柄
+ *\retval SVG_SUCCESS 归还成功
+ *\retval SVG_FAILED 句柄不属于该池或已归还
+ */
+int release_svg_handler(st_svg_handler_pool *pool, st_svg_handler *handler);
+
+/**
+ *\brief 加载并解析svg模板文件
+ *\param[in,out] tpl 模板
+ *\param[in] path 模板文件路径
+ *\retval SVG_SUCCESS 加载成功
+ *\retval SVG_FAILED 文件不存在或解析失败
+ */
+int load_svg_template(st_svg_template *tpl, const char *path);
+
+/**
+ *\brief 销毁svg模板
+ *\param[in,out] tpl 模板
+ *\retval SVG_SUCCESS 成功销毁
+ *\retval SVG_FAILED 模板不可用
+ */
+int destroy_svg_template(st_svg_template *tpl);
+
+/**
+ *\brief 用 xmlDocCopyNode 将模板克隆到句柄中，替换句柄原有的根节点
+ *
+ *	同时为克隆文档建立 id 索引；模板本身只读，多个线程可以同时从同一个模板克隆
+ *
+ *\param[in] tpl 模板
+ *\param[in,out] handler 已初始化的句柄（可来自句柄池）
+ *\retval SVG_SUCCESS 克隆成功
+ *\retval SVG_FAILED 克隆失败
+ */
+int clone_svg_template(const st_svg_template *tpl, st_svg_handler *handler);
+
+/**
+ *\brief 修改克隆文档中指定 id 元素的属性
+ *\param[in] tpl 克隆所用的模板
+ *\param[in,out] handler 克隆后的句柄
+ *\param[in] id 元素的 id
+ *\param[in] name 属性名
+ *\param[in] value 属性值
+ *\retval SVG_SUCCESS 修改成功
+ *\retval SVG_FAILED 克隆文档中没有该 id
+ */
+int patch_svg_attr(const st_svg_template *tpl, st_svg_handler *handler,
+	const char *id, const char *name, const char *value);
+
+/**
+ *\brief 替换克隆文档中指定 id 元素的文本内容，如 <text>
+ *
+ *	元素原有的子节点全部被删除，其中带 id 的元素此后再修补会返回 SVG_FAILED
+ *
+ *\param[in] tpl 克隆所用的模板
+ *\param[in,out] handler 克隆后的句柄
+ *\param[in] id 元素的 id
+ *\param[in] content 新的文本内容，输出时会自动转义
+ *\retval SVG_SUCCESS 修改成功
+ *\retval SVG_FAILED 克隆文档中没有该 id
+ */
+int patch_svg_text(const st_svg_template *tpl, st_svg_handler *handler,
+	const char *id, const char *content);
+
+/**
+ *\brief 将svg序列化到内存缓冲区
+ *
+ *	buffer 中原有数据被覆盖，空间不足时按倍数扩大，可以反复用于多张图片
+ *
+ *\param[in] handler 操作svg图片的句柄
+ *\param[in,out] buffer 内存缓冲区，首次使用前清零即可
+ *\retval SVG_SUCCESS 保存成功
+ *\retval SVG_FAILED 保存失败
+ */
+int save_svg_to_buffer(st_svg_handler *handler, st_svg_buffer *buffer);
+
+/**
+ *\brief 释放内存缓冲区
+ *\param[in,out] buffer 内存缓冲区
+ */
+void free_svg_buffer(st_svg_buffer *buffer);
+
+/**
+ *\brief 将svg序列化后写入文件描述符（文件、管道、socket 等）
+ *
+ *	数据先攒够 SVG_WRITE_CHUNK 字节再 write，不会关闭 fd
+ *
+ *\param[in] handler 操作svg图片的句柄
+ *\param[in] fd 已打开的可写文件描述符
+ *\retval SVG_SUCCESS 保存成功
+ *\retval SVG_FAILED 序列化失败或 write 出错
+ */
+int save_svg_to_fd(st_svg_handler *handler, int fd);
+
 /**
  *\brief 绘制环形百分比图
  */
@@ -35,8 +35,46 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <limits>
+#include <cmath>
 #include <sstream>
 #include <fstream>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <type_traits>
+#include <cstdio>
+#include <cstring>
+#include <cctype>
+#include <thread>
+#include <atomic>
+#include <cerrno>
+
+#include <chrono>
+#include <mutex>
+#include <map>
+#include <typeinfo>
+#include <typeindex>
+#include <functional>
+#include <future>
+#include <condition_variable>
+#include <deque>
+#include <queue>
+#include <list>
+#ifdef __GNUG__
+#include <cxxabi.h>
+#endif
+
+#if __cplusplus >= 201703L
+#include <charconv>
+#include <variant>
+#endif
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include <iostream>
 
@@ -71,9 +109,9 @@ namespace svg
     class optional
     {
     public:
-        optional<T>(T const & type)
+        optional(T const & type)
             : valid(true), type(type) { }
-        optional<T>() : valid(false), type(T()) { }
+        optional() : valid(false), type(T()) { }
         T * operator->()
         {
             // If we try to access an invalid value, an exception is thrown.
@@ -97,53 +135,143 @@ namespace svg
         double height;
     };
 
-    struct Point
+    // Coordinate pair.  Point is the double version used throughout; float or
+    //  integer points halve or quarter the memory of large series.
+    template <typename T>
+    struct BasicPoint
     {
-        Point(double x = 0, double y = 0) : x(x), y(y) { }
-        double x;
-        double y;
+        BasicPoint(T x = 0, T y = 0) : x(x), y(y) { }
+        template <typename U>
+        explicit BasicPoint(BasicPoint<U> const & other)
+            : x(static_cast<T>(other.x)), y(static_cast<T>(other.y)) { }
+        T x;
+        T y;
     };
-    optional<Point> getMinPoint(std::vector<Point> const & points)
+    typedef BasicPoint<double> Point;
+
+    template <typename T>
+    optional<BasicPoint<T> > getMinPoint(std::vector<BasicPoint<T> > const & points)
     {
         if (points.empty())
-            return optional<Point>();
+            return optional<BasicPoint<T> >();
 
-        Point min = points[0];
+        BasicPoint<T> min = points[0];
         for (unsigned i = 0; i < points.size(); ++i) {
             if (points[i].x < min.x)
                 min.x = points[i].x;
             if (points[i].y < min.y)
                 min.y = points[i].y;
         }
-        return optional<Point>(min);
+        return optional<BasicPoint<T> >(min);
     }
-    optional<Point> getMaxPoint(std::vector<Point> const & points)
+    template <typename T>
+    optional<BasicPoint<T> > getMaxPoint(std::vector<BasicPoint<T> > const & points)
     {
         if (points.empty())
-            return optional<Point>();
+            return optional<BasicPoint<T> >();
 
-        Point max = points[0];
+        BasicPoint<T> max = points[0];
         for (unsigned i = 0; i < points.size(); ++i) {
             if (points[i].x > max.x)
                 max.x = points[i].x;
             if (points[i].y > max.y)
                 max.y = points[i].y;
         }
-        return optional<Point>(max);
+        return optional<BasicPoint<T> >(max);
     }
 
+    // Read-only view of a raw file of little-endian x,y pairs (float64 or
+    //  float32), mapped rather than loaded so huge series cost page cache
+    //  instead of heap.  Copies share the mapping; it is unmapped with the
+    //  last copy.  A file that cannot be mapped gives an empty series.
+    class MappedSeries
+    {
+    public:
+        enum Precision { Float64 = 8, Float32 = 4 };
+
+        MappedSeries() : data(0), count(0), precision(Float64) { }
+        explicit MappedSeries(std::string const & file_name, Precision precision = Float64)
+            : data(0), count(0), precision(precision)
+        {
+            int fd = open(file_name.c_str(), O_RDONLY);
+            if (fd < 0)
+                return;
+
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size >= 2 * precision) {
+                void * address = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (address != MAP_FAILED) {
+                    madvise(address, st.st_size, MADV_SEQUENTIAL);
+                    mapping.reset(new Mapping(address, st.st_size));
+                    data = static_cast<char const *>(address);
+                    count = st.st_size / (2 * precision);
+                }
+            }
+            close(fd);
+        }
+        bool empty() const { return count == 0; }
+        size_t size() const { return count; }
+        Point operator[](size_t i) const
+        {
+            char const * record = data + i * 2 * precision;
+            return Point(value(record), value(record + precision));
+        }
+    private:
+        struct Mapping
+        {
+            Mapping(void * address, size_t length) : address(address), length(length) { }
+            ~Mapping() { munmap(address, length); }
+            void * address;
+            size_t length;
+        };
+
+        std::shared_ptr<Mapping> mapping;
+        char const * data;
+        size_t count;
+        Precision precision;
+
+        // Records need not be aligned, so values are assembled byte-wise.
+        double value(char const * bytes) const
+        {
+            unsigned char const * in = reinterpret_cast<unsigned char const *>(bytes);
+            unsigned long long bits = 0;
+            for (unsigned i = precision; i-- > 0; )
+                bits = (bits << 8) | in[i];
+
+            if (precision == Float32) {
+                unsigned narrow = static_cast<unsigned>(bits);
+                float result;
+                std::memcpy(&result, &narrow, sizeof(result));
+                return result;
+            }
+            double result;
+            std::memcpy(&result, &bits, sizeof(result));
+            return result;
+        }
+    };
+
+    class StyleSheet;
+    class Definitions;
+
     // Defines the dimensions, scale, origin, and origin offset of the document.
+    //  When style_sheet is set, shapes emit a class reference instead of their
+    //  fill/stroke/font attributes; when definitions is set, gradients and
+    //  patterns used by fills are collected there.  Document sets both while
+    //  serializing.
     struct Layout
     {
         enum Origin { TopLeft, BottomLeft, TopRight, BottomRight };
 
         Layout(Dimensions const & dimensions = Dimensions(400, 300), Origin origin = BottomLeft,
             double scale = 1, Point const & origin_offset = Point(0, 0))
-            : dimensions(dimensions), scale(scale), origin(origin), origin_offset(origin_offset) { }
+            : dimensions(dimensions), scale(scale), origin(origin), origin_offset(origin_offset),
+            style_sheet(0), definitions(0) { }
         Dimensions dimensions;
         double scale;
         Origin origin;
         Point origin_offset;
+        StyleSheet * style_sheet;
+        Definitions * definitions;
     };
 
     // Convert coordinates in user space to SVG native space.
@@ -167,14 +295,224 @@ namespace svg
         return dimension * layout.scale;
     }
 
+    // Axis-aligned bounding box in SVG native space (after Layout translation).
+    //  A default constructed box is empty; an unbounded box intersects everything.
+    struct Box
+    {
+        Box() : min_x(std::numeric_limits<double>::max()), min_y(std::numeric_limits<double>::max()),
+            max_x(-std::numeric_limits<double>::max()), max_y(-std::numeric_limits<double>::max()) { }
+        Box(double min_x, double min_y, double max_x, double max_y)
+            : min_x(min_x), min_y(min_y), max_x(max_x), max_y(max_y) { }
+        static Box unbounded()
+        {
+            double inf = std::numeric_limits<double>::infinity();
+            return Box(-inf, -inf, inf, inf);
+        }
+        bool empty() const { return min_x > max_x || min_y > max_y; }
+        bool bounded() const
+        {
+            return !empty() && min_x > -std::numeric_limits<double>::max()
+                && min_y > -std::numeric_limits<double>::max()
+                && max_x < std::numeric_limits<double>::max()
+                && max_y < std::numeric_limits<double>::max();
+        }
+        double width() const { return max_x - min_x; }
+        double height() const { return max_y - min_y; }
+        void include(double x, double y)
+        {
+            min_x = std::min(min_x, x);
+            min_y = std::min(min_y, y);
+            max_x = std::max(max_x, x);
+            max_y = std::max(max_y, y);
+        }
+        void include(Box const & box)
+        {
+            if (box.empty())
+                return;
+            include(box.min_x, box.min_y);
+            include(box.max_x, box.max_y);
+        }
+        // Grow the box by margin on every side, e.g. half a stroke width.
+        Box padded(double margin) const
+        {
+            if (empty())
+                return *this;
+            return Box(min_x - margin, min_y - margin, max_x + margin, max_y + margin);
+        }
+        bool intersects(Box const & other) const
+        {
+            return !empty() && !other.empty() && min_x <= other.max_x && other.min_x <= max_x
+                && min_y <= other.max_y && other.min_y <= max_y;
+        }
+        double min_x;
+        double min_y;
+        double max_x;
+        double max_y;
+    };
+
+    // Output for the two-pass serializer.  A Writer without a buffer only counts
+    //  bytes; a Writer over a buffer of exactly that size then fills it, so a
+    //  shape is serialized with a single allocation and no intermediate strings.
+    class Writer
+    {
+    public:
+        Writer() : out(0), length(0) { }
+        explicit Writer(char * out) : out(out), length(0) { }
+        bool counting() const { return out == 0; }
+        size_t size() const { return length; }
+
+        Writer & write(char const * data, size_t size)
+        {
+            if (out)
+                std::copy(data, data + size, out + length);
+            length += size;
+            return *this;
+        }
+        Writer & operator<<(char c)
+        {
+            if (out)
+                out[length] = c;
+            ++length;
+            return *this;
+        }
+        Writer & operator<<(char const * str)
+        {
+            return write(str, std::char_traits<char>::length(str));
+        }
+        Writer & operator<<(std::string const & str)
+        {
+            return write(str.data(), str.size());
+        }
+        Writer & operator<<(int value)
+        {
+            return writeInteger(value);
+        }
+        // Room for size bytes at the end, filled in by the caller (null while
+        //  counting); with commit, the interface Image::streamTo writes to.
+        char * extend(size_t size)
+        {
+            char * at = out ? out + length : 0;
+            length += size;
+            return at;
+        }
+        void commit() { }
+        // Same text as std::ostream's default formatting (%g, precision 6).
+        //  Integral values below 1e6 are printed, or counted, from their digits,
+        //  as are other values in %g's fixed-notation range unless rounding to
+        //  six digits is too close to a tie to decide without snprintf.
+        Writer & operator<<(double value)
+        {
+            if (value == std::floor(value) && std::fabs(value) < 1e6 && !(value == 0 && std::signbit(value)))
+                return writeInteger(static_cast<long long>(value));
+            if (writeFixed(value))
+                return *this;
+
+            char buffer[32];
+            int size = std::snprintf(buffer, sizeof(buffer), "%g", value);
+            return write(buffer, size);
+        }
+        // name="value[unit]" followed by a space, as attribute() formats it.
+        template <typename T>
+        Writer & attribute(char const * name, T const & value, char const * unit = "")
+        {
+            return *this << name << "=\"" << value << unit << "\" ";
+        }
+    private:
+        char * out;
+        size_t length;
+
+        bool writeFixed(double value)
+        {
+            static double const powers[] = { 1e-4, 1e-3, 1e-2, 1e-1, 1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6,
+                1e7, 1e8, 1e9 };
+            double magnitude = std::fabs(value);
+            if (!(magnitude >= 1e-4 && magnitude < 1e6))
+                return false;
+
+            // magnitude is in [10^exponent, 10^(exponent + 1)).
+            int exponent = -4;
+            while (exponent < 5 && magnitude >= powers[exponent + 5])
+                ++exponent;
+            double scaled = magnitude * powers[9 - exponent];
+            double whole = std::floor(scaled);
+            if (std::fabs(scaled - whole - 0.5) < 1e-6)
+                return false;
+            long long digits = static_cast<long long>(whole) + (scaled - whole > 0.5 ? 1 : 0);
+            if (digits < 100000 || digits >= 1000000)
+                return false;
+
+            // Six significant digits, the point after exponent + 1 of them.
+            char text[16];
+            for (int i = 5; i >= 0; --i, digits /= 10)
+                text[i] = static_cast<char>('0' + digits % 10);
+            int end = 6;
+            int point = exponent + 1;
+            while (end > std::max(point, 0) && text[end - 1] == '0')
+                --end;
+
+            if (value < 0)
+                *this << '-';
+            if (point <= 0) {
+                write("0.", 2);
+                for (int i = point; i < 0; ++i)
+                    *this << '0';
+                write(text, end);
+            }
+            else {
+                write(text, point);
+                if (end > point) {
+                    *this << '.';
+                    write(text + point, end - point);
+                }
+            }
+            return true;
+        }
+        Writer & writeInteger(long long value)
+        {
+            unsigned long long magnitude = value < 0 ? 0ULL - value : value;
+            unsigned digits = 1;
+            for (unsigned long long rest = magnitude; rest >= 10; rest /= 10)
+                ++digits;
+            if (value < 0)
+                *this << '-';
+            if (out) {
+                char * end = out + length + digits;
+                do {
+                    *--end = static_cast<char>('0' + magnitude % 10);
+                    magnitude /= 10;
+                } while (magnitude);
+            }
+            length += digits;
+            return *this;
+        }
+    };
+
     class Serializeable
     {
     public:
         Serializeable() { }
         virtual ~Serializeable() { };
         virtual std::string toString(Layout const & layout) const = 0;
+        // Fast path used by Document; the default falls back to toString.
+        virtual void serialize(Writer & out, Layout const & layout) const
+        {
+            out << toString(layout);
+        }
     };
 
+    // Two-pass toString: count, allocate once, then write.
+    std::string serializeToString(Serializeable const & serializeable, Layout const & layout)
+    {
+        Writer counter;
+        serializeable.serialize(counter, layout);
+        std::string str(counter.size(), '\0');
+        if (!str.empty()) {
+            Writer writer(&str[0]);
+            serializeable.serialize(writer, layout);
+        }
+        return str;
+    }
+
     class Color : public Serializeable
     {
     public:
@@ -206,14 +544,21 @@ namespace svg
             }
         }
         virtual ~Color() { }
-        std::string toString(Layout const &) const
+        std::string toString(Layout const & layout) const
+        {
+            return serializeToString(*this, layout);
+        }
+        void serialize(Writer & out, Layout const &) const
         {
-            std::stringstream ss;
             if (transparent)
-                ss << "transparent";
+                out << "transparent";
             else
-                ss << "rgb(" << red << "," << green << "," << blue << ")";
-            return ss.str();
+                out << "rgb(" << red << "," << green << "," << blue << ")";
+        }
+        // Packed 0xRRGGBB, or -1 when transparent.
+        int getKey() const
+        {
+            return transparent ? -1 : (red << 16) | (green << 8) | blue;
         }
     private:
             bool transparent;
@@ -229,414 +574,4603 @@ namespace svg
             }
     };
 
-    class Fill : public Serializeable
+    // 64-bit FNV-1a, used to derive definition ids from their content.
+    unsigned long long hashString(std::string const & str)
+    {
+        unsigned long long hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < str.size(); ++i) {
+            hash ^= static_cast<unsigned char>(str[i]);
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    // 64-bit XXH64 of size bytes, read little-endian.  Many times faster than
+    //  hashString on large inputs; used to key whole rendered documents.
+    unsigned long long hashBytes(void const * data, size_t size, unsigned long long seed = 0)
+    {
+        static unsigned long long const prime1 = 0x9E3779B185EBCA87ULL, prime2 = 0xC2B2AE3D27D4EB4FULL,
+            prime3 = 0x165667B19E3779F9ULL, prime4 = 0x85EBCA77C2B2AE63ULL, prime5 = 0x27D4EB2F165667C5ULL;
+        struct Mix
+        {
+            static unsigned long long rotate(unsigned long long value, int bits)
+            {
+                return (value << bits) | (value >> (64 - bits));
+            }
+            static unsigned long long round(unsigned long long acc, unsigned long long input)
+            {
+                return rotate(acc + input * prime2, 31) * prime1;
+            }
+            static unsigned long long merge(unsigned long long acc, unsigned long long lane)
+            {
+                return (acc ^ round(0, lane)) * prime1 + prime4;
+            }
+            static unsigned long long read64(unsigned char const * p)
+            {
+                unsigned long long value = 0;
+                for (int i = 7; i >= 0; --i)
+                    value = (value << 8) | p[i];
+                return value;
+            }
+            static unsigned long long read32(unsigned char const * p)
+            {
+                return static_cast<unsigned long long>(p[0]) | (static_cast<unsigned long long>(p[1]) << 8)
+                    | (static_cast<unsigned long long>(p[2]) << 16) | (static_cast<unsigned long long>(p[3]) << 24);
+            }
+        };
+
+        unsigned char const * p = static_cast<unsigned char const *>(data);
+        unsigned char const * const end = p + size;
+        unsigned long long hash;
+        if (size >= 32) {
+            unsigned long long v1 = seed + prime1 + prime2, v2 = seed + prime2, v3 = seed, v4 = seed - prime1;
+            for (; p + 32 <= end; p += 32) {
+                v1 = Mix::round(v1, Mix::read64(p));
+                v2 = Mix::round(v2, Mix::read64(p + 8));
+                v3 = Mix::round(v3, Mix::read64(p + 16));
+                v4 = Mix::round(v4, Mix::read64(p + 24));
+            }
+            hash = Mix::rotate(v1, 1) + Mix::rotate(v2, 7) + Mix::rotate(v3, 12) + Mix::rotate(v4, 18);
+            hash = Mix::merge(hash, v1);
+            hash = Mix::merge(hash, v2);
+            hash = Mix::merge(hash, v3);
+            hash = Mix::merge(hash, v4);
+        }
+        else
+            hash = seed + prime5;
+        hash += size;
+
+        for (; p + 8 <= end; p += 8)
+            hash = Mix::rotate(hash ^ Mix::round(0, Mix::read64(p)), 27) * prime1 + prime4;
+        if (p + 4 <= end) {
+            hash = Mix::rotate(hash ^ (Mix::read32(p) * prime1), 23) * prime2 + prime3;
+            p += 4;
+        }
+        for (; p < end; ++p)
+            hash = Mix::rotate(hash ^ (*p * prime5), 11) * prime1;
+
+        hash ^= hash >> 33;
+        hash *= prime2;
+        hash ^= hash >> 29;
+        hash *= prime3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+
+    // Paint server (gradient, pattern) emitted once in <defs> and referenced by
+    //  id.  The id is a hash of the markup, so identical definitions share one
+    //  entry no matter how many fills or documents use them.
+    class Definition : public Serializeable
     {
     public:
-        Fill(Color::Defaults color) : color(color) { }
-        Fill(Color color = Color::Transparent)
-            : color(color) { }
+        Definition() : cached_scale(0) { }
+        virtual ~Definition() { }
+        // Full element, including its id.
         std::string toString(Layout const & layout) const
         {
-            std::stringstream ss;
-            ss << attribute("fill", color.toString(layout));
-            return ss.str();
+            update(layout);
+            return cached_markup;
+        }
+        std::string const & getId(Layout const & layout) const
+        {
+            update(layout);
+            return cached_id;
         }
+    protected:
+        virtual std::string elementName() const = 0;
+        virtual std::string attributeString(Layout const & layout) const = 0;
+        virtual std::string childrenString(Layout const & layout) const = 0;
+        // Call from mutators so the cached markup is rebuilt.
+        void invalidate() { cached_id.clear(); }
     private:
-        Color color;
+        // Markup only depends on the layout scale; shapes sharing a Fill share
+        //  this cache, so each definition is serialized and hashed once.
+        mutable double cached_scale;
+        mutable std::string cached_id;
+        mutable std::string cached_markup;
+
+        void update(Layout const & layout) const
+        {
+            if (!cached_id.empty() && cached_scale == layout.scale)
+                return;
+
+            std::string attributes = attributeString(layout);
+            std::string children = childrenString(layout);
+            char id[24];
+            std::snprintf(id, sizeof(id), "d%016llx", hashString(elementName() + attributes + children));
+            cached_id = id;
+            cached_markup = "\t\t<" + elementName() + " " + attribute("id", cached_id) + attributes
+                + ">\n" + children + "\t\t</" + elementName() + ">\n";
+            cached_scale = layout.scale;
+        }
     };
 
-    class Stroke : public Serializeable
+    // Collects the definitions referenced while serializing a document.
+    class Definitions
     {
     public:
-        Stroke(double width = -1, Color color = Color::Transparent)
-            : width(width), color(color) { }
-        std::string toString(Layout const & layout) const
+        // Definitions already in known are referenced but not repeated here.
+        explicit Definitions(Definitions const * known = 0) : known(known) { }
+        std::string const & add(Definition const & definition, Layout const & layout)
         {
-            // If stroke width is invalid.
-            if (width < 0)
+            std::string const & id = definition.getId(layout);
+            if ((!known || !known->ids.count(id)) && ids.insert(id).second)
+                markup += definition.toString(layout);
+            return id;
+        }
+        bool empty() const { return ids.empty(); }
+        std::string toString() const
+        {
+            if (ids.empty())
                 return std::string();
-
-            std::stringstream ss;
-            ss << attribute("stroke-width", translateScale(width, layout)) << attribute("stroke", color.toString(layout));
-            return ss.str();
+            return "\t<defs>\n" + markup + "\t</defs>\n";
         }
     private:
-        double width;
+        Definitions const * known;
+        std::unordered_set<std::string> ids;
+        std::string markup;
+    };
+
+    struct Stop
+    {
+        Stop(double offset, Color const & color, double opacity = 1)
+            : offset(offset), color(color), opacity(opacity) { }
+        double offset;  // 0 to 1
         Color color;
+        double opacity;
     };
 
-    class Font : public Serializeable
+    class Gradient : public Definition
     {
     public:
-        Font(double size = 12, std::string const & family = "Verdana") : size(size), family(family) { }
-        std::string toString(Layout const & layout) const
+        enum Spread { Pad, Reflect, Repeat };
+
+        Gradient & operator<<(Stop const & stop)
+        {
+            stops.push_back(stop);
+            invalidate();
+            return *this;
+        }
+    protected:
+        Gradient(Spread spread) : spread(spread) { }
+        std::string spreadString() const
+        {
+            if (spread == Reflect)
+                return attribute("spreadMethod", "reflect");
+            if (spread == Repeat)
+                return attribute("spreadMethod", "repeat");
+            return std::string();
+        }
+        std::string childrenString(Layout const & layout) const
         {
             std::stringstream ss;
-            ss << attribute("font-size", translateScale(size, layout)) << attribute("font-family", family);
+            for (unsigned i = 0; i < stops.size(); ++i) {
+                ss << "\t\t\t<stop " << attribute("offset", stops[i].offset * 100, "%")
+                    << attribute("stop-color", stops[i].color.toString(layout));
+                if (stops[i].opacity < 1)
+                    ss << attribute("stop-opacity", stops[i].opacity);
+                ss << emptyElemEnd();
+            }
             return ss.str();
         }
     private:
-        double size;
-        std::string family;
+        Spread spread;
+        std::vector<Stop> stops;
     };
 
-    class Shape : public Serializeable
+    // Coordinates are fractions of the filled shape's bounding box.
+    class LinearGradient : public Gradient
     {
     public:
-        Shape(Fill const & fill = Fill(), Stroke const & stroke = Stroke())
-            : fill(fill), stroke(stroke) { }
-        virtual ~Shape() { }
-        virtual std::string toString(Layout const & layout) const = 0;
-        virtual void offset(Point const & offset) = 0;
+        LinearGradient(Point const & start = Point(0, 0), Point const & end = Point(1, 0),
+            Spread spread = Pad)
+            : Gradient(spread), start(start), end(end) { }
+        LinearGradient & operator<<(Stop const & stop)
+        {
+            Gradient::operator<<(stop);
+            return *this;
+        }
     protected:
-        Fill fill;
-        Stroke stroke;
+        std::string elementName() const { return "linearGradient"; }
+        std::string attributeString(Layout const &) const
+        {
+            std::stringstream ss;
+            ss << attribute("x1", start.x * 100, "%") << attribute("y1", start.y * 100, "%")
+                << attribute("x2", end.x * 100, "%") << attribute("y2", end.y * 100, "%")
+                << spreadString();
+            return ss.str();
+        }
+    private:
+        Point start;
+        Point end;
     };
-    template <typename T>
-    std::string vectorToString(std::vector<T> collection, Layout const & layout)
-    {
-        std::string combination_str;
-        for (unsigned i = 0; i < collection.size(); ++i)
-            combination_str += collection[i].toString(layout);
-
-        return combination_str;
-    }
 
-    class Circle : public Shape
+    // Coordinates are fractions of the filled shape's bounding box.
+    class RadialGradient : public Gradient
     {
     public:
-        Circle(Point const & center, double diameter, Fill const & fill,
-            Stroke const & stroke = Stroke())
-            : Shape(fill, stroke), center(center), radius(diameter / 2) { }
-        std::string toString(Layout const & layout) const
+        RadialGradient(Point const & center = Point(.5, .5), double radius = .5,
+            Spread spread = Pad)
+            : Gradient(spread), center(center), focal(center), radius(radius) { }
+        RadialGradient(Point const & center, double radius, Point const & focal,
+            Spread spread = Pad)
+            : Gradient(spread), center(center), focal(focal), radius(radius) { }
+        RadialGradient & operator<<(Stop const & stop)
         {
-            std::stringstream ss;
-            ss << elemStart("circle") << attribute("cx", translateX(center.x, layout))
-                << attribute("cy", translateY(center.y, layout))
-                << attribute("r", translateScale(radius, layout)) << fill.toString(layout)
-                << stroke.toString(layout) << emptyElemEnd();
-            return ss.str();
+            Gradient::operator<<(stop);
+            return *this;
         }
-        void offset(Point const & offset)
+    protected:
+        std::string elementName() const { return "radialGradient"; }
+        std::string attributeString(Layout const &) const
         {
-            center.x += offset.x;
-            center.y += offset.y;
+            std::stringstream ss;
+            ss << attribute("cx", center.x * 100, "%") << attribute("cy", center.y * 100, "%")
+                << attribute("r", radius * 100, "%") << attribute("fx", focal.x * 100, "%")
+                << attribute("fy", focal.y * 100, "%") << spreadString();
+            return ss.str();
         }
     private:
         Point center;
+        Point focal;
         double radius;
     };
 
-    class Elipse : public Shape
+    class Fill : public Serializeable
     {
     public:
-        Elipse(Point const & center, double width, double height,
-            Fill const & fill = Fill(), Stroke const & stroke = Stroke())
-            : Shape(fill, stroke), center(center), radius_width(width / 2),
-            radius_height(height / 2) { }
+        Fill(Color::Defaults color) : color(color) { }
+        Fill(Color color = Color::Transparent)
+            : color(color) { }
+        // Fill with a gradient or pattern; the definition is shared by copies of this fill.
+        template <typename T>
+        Fill(T const & definition,
+            typename std::enable_if<std::is_base_of<Definition, T>::value>::type * = 0)
+            : color(Color::Transparent), definition(std::make_shared<T>(definition)) { }
         std::string toString(Layout const & layout) const
         {
-            std::stringstream ss;
-            ss << elemStart("ellipse") << attribute("cx", translateX(center.x, layout))
-                << attribute("cy", translateY(center.y, layout))
-                << attribute("rx", translateScale(radius_width, layout))
-                << attribute("ry", translateScale(radius_height, layout))
-                << fill.toString(layout) << stroke.toString(layout) << emptyElemEnd();
-            return ss.str();
+            return serializeToString(*this, layout);
         }
-        void offset(Point const & offset)
+        void serialize(Writer & out, Layout const & layout) const
         {
-            center.x += offset.x;
-            center.y += offset.y;
+            out << "fill=\"";
+            if (definition)
+                out << paintString(layout);
+            else
+                color.serialize(out, layout);
+            out << "\" ";
+        }
+        // Color, or url(#id) for definitions (registered with layout.definitions).
+        std::string paintString(Layout const & layout) const
+        {
+            if (!definition)
+                return color.toString(layout);
+            if (layout.definitions)
+                return "url(#" + layout.definitions->add(*definition, layout) + ")";
+            return "url(#" + definition->getId(layout) + ")";
         }
+        Color const & getColor() const { return color; }
+        Definition const * getDefinition() const { return definition.get(); }
     private:
-        Point center;
-        double radius_width;
-        double radius_height;
+        Color color;
+        std::shared_ptr<Definition const> definition;
     };
 
-    class Rectangle : public Shape
+    class Stroke : public Serializeable
     {
     public:
-        Rectangle(Point const & edge, double width, double height,
-            Fill const & fill = Fill(), Stroke const & stroke = Stroke())
-            : Shape(fill, stroke), edge(edge), width(width),
-            height(height) { }
+        Stroke(double width = -1, Color color = Color::Transparent)
+            : width(width), color(color) { }
         std::string toString(Layout const & layout) const
         {
-            std::stringstream ss;
-            ss << elemStart("rect") << attribute("x", translateX(edge.x, layout))
-                << attribute("y", translateY(edge.y, layout))
-                << attribute("width", translateScale(width, layout))
-                << attribute("height", translateScale(height, layout))
-                << fill.toString(layout) << stroke.toString(layout) << emptyElemEnd();
-            return ss.str();
+            return serializeToString(*this, layout);
         }
-        void offset(Point const & offset)
+        void serialize(Writer & out, Layout const & layout) const
         {
-            edge.x += offset.x;
-            edge.y += offset.y;
+            // If stroke width is invalid.
+            if (width < 0)
+                return;
+
+            out.attribute("stroke-width", translateScale(width, layout)) << "stroke=\"";
+            color.serialize(out, layout);
+            out << "\" ";
+        }
+        double getWidth() const { return width; }
+        Color const & getColor() const { return color; }
+        // Half the scaled stroke width; how far the stroke extends outside the geometry.
+        double getOverhang(Layout const & layout) const
+        {
+            return width < 0 ? 0 : translateScale(width, layout) / 2;
         }
     private:
-        Point edge;
         double width;
-        double height;
+        Color color;
     };
 
-    class Line : public Shape
+    class Font : public Serializeable
     {
     public:
-        Line(Point const & start_point, Point const & end_point,
-            Stroke const & stroke = Stroke())
-            : Shape(Fill(), stroke), start_point(start_point),
-            end_point(end_point) { }
+        Font(double size = 12, std::string const & family = "Verdana") : size(size), family(family) { }
+        double getSize() const { return size; }
+        std::string const & getFamily() const { return family; }
         std::string toString(Layout const & layout) const
         {
-            std::stringstream ss;
-            ss << elemStart("line") << attribute("x1", translateX(start_point.x, layout))
-                << attribute("y1", translateY(start_point.y, layout))
-                << attribute("x2", translateX(end_point.x, layout))
-                << attribute("y2", translateY(end_point.y, layout))
-                << stroke.toString(layout) << emptyElemEnd();
-            return ss.str();
+            return serializeToString(*this, layout);
         }
-        void offset(Point const & offset)
+        void serialize(Writer & out, Layout const & layout) const
         {
-            start_point.x += offset.x;
-            start_point.y += offset.y;
-
-            end_point.x += offset.x;
-            end_point.y += offset.y;
+            out.attribute("font-size", translateScale(size, layout)).attribute("font-family", family);
         }
     private:
-        Point start_point;
-        Point end_point;
+        double size;
+        std::string family;
     };
 
-    class Polygon : public Shape
+    // Advance widths of printable ASCII (32 to 126) in 1/1000 em for the
+    //  families the library knows: Verdana (the default font), a Helvetica/
+    //  Arial-like sans and a fixed-width mono.  Other characters use the
+    //  width of 'n'; a UTF-8 sequence counts once.
+    class FontMetrics
     {
     public:
-        Polygon(Fill const & fill = Fill(), Stroke const & stroke = Stroke())
-            : Shape(fill, stroke) { }
-        Polygon(Stroke const & stroke = Stroke()) : Shape(Color::Transparent, stroke) { }
-        Polygon & operator<<(Point const & point)
+        enum Family { Verdana, Sans, Mono };
+
+        explicit FontMetrics(Family family = Verdana) : widths(table(family)) { }
+        // First family of a CSS font-family list that is known, else Verdana.
+        static Family resolve(std::string const & family_list)
         {
-            points.push_back(point);
-            return *this;
+            std::string list(family_list);
+            std::transform(list.begin(), list.end(), list.begin(), ::tolower);
+            std::stringstream ss(list);
+            std::string name;
+            while (std::getline(ss, name, ',')) {
+                size_t first = name.find_first_not_of(" \t'\"");
+                size_t last = name.find_last_not_of(" \t'\"");
+                if (first == std::string::npos)
+                    continue;
+                name = name.substr(first, last - first + 1);
+                if (name == "verdana")
+                    return Verdana;
+                if (name == "sans-serif" || name == "sans" || name == "arial" || name == "helvetica")
+                    return Sans;
+                if (name == "monospace" || name == "mono" || name == "courier" || name == "courier new")
+                    return Mono;
+            }
+            return Verdana;
         }
-        std::string toString(Layout const & layout) const
+        // Width of text in em.
+        double advance(std::string const & text) const
         {
-            std::stringstream ss;
-            ss << elemStart("polygon");
+            unsigned total = 0;
+            for (size_t i = 0; i < text.size(); ++i) {
+                unsigned char c = text[i];
+                if (c >= 32 && c < 127)
+                    total += widths[c - 32];
+                else if ((c & 0xC0) != 0x80)
+                    total += widths['n' - 32];
+            }
+            return total / 1000.0;
+        }
+    private:
+        unsigned short const * widths;
 
-            ss << "points=\"";
-            for (unsigned i = 0; i < points.size(); ++i)
-                ss << translateX(points[i].x, layout) << "," << translateY(points[i].y, layout) << " ";
-            ss << "\" ";
+        static unsigned short const * table(Family family)
+        {
+            static unsigned short const verdana[95] = {
+                352, 394, 459, 818, 636, 1076, 727, 269, 454, 454, 636, 818, 364, 454, 364, 454,
+                636, 636, 636, 636, 636, 636, 636, 636, 636, 636, 454, 454, 818, 818, 818, 545,
+                1000, 684, 686, 698, 771, 632, 575, 775, 751, 421, 455, 693, 557, 843, 748, 787,
+                603, 787, 695, 684, 616, 732, 684, 989, 685, 615, 685, 454, 454, 454, 818, 636,
+                636, 601, 623, 521, 623, 596, 352, 623, 633, 274, 344, 592, 274, 973, 633, 607,
+                623, 623, 427, 521, 394, 633, 592, 818, 592, 592, 525, 635, 454, 635, 818 };
+            static unsigned short const sans[95] = {
+                278, 278, 355, 556, 556, 889, 667, 191, 333, 333, 389, 584, 278, 333, 278, 278,
+                556, 556, 556, 556, 556, 556, 556, 556, 556, 556, 278, 278, 584, 584, 584, 556,
+                1015, 667, 667, 722, 722, 667, 611, 778, 722, 278, 500, 667, 556, 833, 722, 778,
+                667, 778, 722, 667, 611, 722, 667, 944, 667, 667, 611, 278, 278, 278, 469, 556,
+                333, 556, 556, 500, 556, 556, 278, 556, 556, 222, 222, 500, 222, 833, 556, 556,
+                556, 556, 333, 500, 278, 556, 500, 722, 500, 500, 500, 334, 260, 334, 584 };
+            static unsigned short const mono[95] = {
+                600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600,
+                600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600,
+                600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600,
+                600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600,
+                600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600,
+                600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600, 600 };
+            return family == Sans ? sans : family == Mono ? mono : verdana;
+        }
+    };
 
-            ss << fill.toString(layout) << stroke.toString(layout) << emptyElemEnd();
-            return ss.str();
+    // Width of text set in font, in the font's units.  Family lists and
+    //  measured strings are cached per thread, so repeated axis labels cost a
+    //  hash lookup.
+    double measure(std::string const & text, Font const & font)
+    {
+        struct Cache
+        {
+            std::unordered_map<std::string, FontMetrics::Family> families;
+            std::unordered_map<std::string, double> advances[3];
+        };
+        static thread_local Cache cache;
+
+        std::unordered_map<std::string, FontMetrics::Family>::const_iterator family =
+            cache.families.find(font.getFamily());
+        if (family == cache.families.end())
+            family = cache.families.emplace(font.getFamily(), FontMetrics::resolve(font.getFamily())).first;
+
+        std::unordered_map<std::string, double> & advances = cache.advances[family->second];
+        std::unordered_map<std::string, double>::const_iterator advance = advances.find(text);
+        if (advance == advances.end()) {
+            // Bounded: a long run of distinct strings starts the cache over.
+            if (advances.size() >= 65536)
+                advances.clear();
+            advance = advances.emplace(text, FontMetrics(family->second).advance(text)).first;
         }
-        void offset(Point const & offset)
+        return advance->second * font.getSize();
+    }
+
+    // Interns Fill + Stroke + Font combinations into CSS classes.  Each distinct
+    //  combination is formatted once; later shapes with the same style only
+    //  carry class="sN".
+    class StyleSheet
+    {
+    public:
+        // Returns the class name for the combination; fill or font may be null
+        //  when the element does not carry them (e.g. Line has no fill).
+        std::string const & intern(Fill const * fill, Stroke const & stroke, Font const * font,
+            Layout const & layout)
         {
-            for (unsigned i = 0; i < points.size(); ++i) {
-                points[i].x += offset.x;
-                points[i].y += offset.y;
+            Key key;
+            key.fill = fill ? fill->getColor().getKey() : 0;
+            if (fill && fill->getDefinition())
+                key.paint_server = fill->getDefinition()->getId(layout);
+            key.stroke = stroke.getColor().getKey();
+            key.stroke_width = stroke.getWidth() < 0 ? -1 : stroke.getWidth();
+            key.font_size = font ? font->getSize() : 0;
+            key.family = font ? font->getFamily() : std::string();
+            key.parts = (fill ? 1 : 0) | (font ? 2 : 0);
+
+            std::unordered_map<Key, unsigned, KeyHash>::const_iterator it = classes.find(key);
+            if (it != classes.end())
+                return names[it->second];
+
+            std::stringstream name;
+            name << "s" << names.size();
+            std::stringstream rule;
+            rule << "." << name.str() << "{";
+            if (fill)
+                rule << "fill:" << fill->paintString(layout) << ";";
+            if (stroke.getWidth() >= 0)
+                rule << "stroke-width:" << translateScale(stroke.getWidth(), layout) << "px;"
+                    << "stroke:" << stroke.getColor().toString(layout) << ";";
+            if (font) {
+                rule << "font-size:" << translateScale(font->getSize(), layout) << "px;";
+                if (font->getFamily().find(' ') != std::string::npos)
+                    rule << "font-family:'" << font->getFamily() << "';";
+                else
+                    rule << "font-family:" << font->getFamily() << ";";
             }
+            rule << "}\n";
+
+            classes[key] = static_cast<unsigned>(names.size());
+            names.push_back(name.str());
+            rules += rule.str();
+            return names.back();
+        }
+        bool empty() const { return names.empty(); }
+        std::string toString() const
+        {
+            if (names.empty())
+                return std::string();
+            return "\t<style type=\"text/css\"><![CDATA[\n" + rules + "]]></style>\n";
         }
     private:
-        std::vector<Point> points;
+        struct Key
+        {
+            int fill;
+            int stroke;
+            double stroke_width;
+            double font_size;
+            std::string family;
+            std::string paint_server;
+            int parts;
+            bool operator==(Key const & other) const
+            {
+                return fill == other.fill && stroke == other.stroke && stroke_width == other.stroke_width
+                    && font_size == other.font_size && parts == other.parts && family == other.family
+                    && paint_server == other.paint_server;
+            }
+        };
+        struct KeyHash
+        {
+            size_t operator()(Key const & key) const
+            {
+                size_t h = std::hash<int>()(key.fill);
+                h = h * 31 + std::hash<int>()(key.stroke);
+                h = h * 31 + std::hash<double>()(key.stroke_width);
+                h = h * 31 + std::hash<double>()(key.font_size);
+                h = h * 31 + std::hash<std::string>()(key.family);
+                h = h * 31 + std::hash<std::string>()(key.paint_server);
+                return h * 31 + key.parts;
+            }
+        };
+
+        std::unordered_map<Key, unsigned, KeyHash> classes;
+        std::vector<std::string> names;
+        std::string rules;
     };
 
-    class Polyline : public Shape
+    // Writes all of data to fd, resuming after signals and partial writes.
+    bool writeAll(int fd, char const * data, size_t size)
     {
-    public:
-        Polyline(Fill const & fill = Fill(), Stroke const & stroke = Stroke())
-            : Shape(fill, stroke) { }
-        Polyline(Stroke const & stroke = Stroke()) : Shape(Color::Transparent, stroke) { }
-        Polyline(std::vector<Point> const & points,
-            Fill const & fill = Fill(), Stroke const & stroke = Stroke())
-            : Shape(fill, stroke), points(points) { }
-        Polyline & operator<<(Point const & point)
+        while (size > 0) {
+            ssize_t written = ::write(fd, data, size);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            data += written;
+            size -= written;
+        }
+        return true;
+    }
+
+    // Opens path (relative to directory_fd) to be written from scratch.  A
+    //  regular file with other hard links, such as one a RenderCache served,
+    //  is unlinked first, so the new content never reaches the shared inode.
+    int createFile(std::string const & path, int directory_fd = AT_FDCWD)
+    {
+        struct stat st;
+        if (fstatat(directory_fd, path.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0
+            && S_ISREG(st.st_mode) && st.st_nlink > 1)
+            unlinkat(directory_fd, path.c_str(), 0);
+        return openat(directory_fd, path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+
+    // CRC-32 (ISO 3309) of size bytes, continuing from crc; PNG chunk checksum.
+    unsigned crc32(unsigned char const * data, size_t size, unsigned crc = 0)
+    {
+        struct Table
         {
-            points.push_back(point);
-            return *this;
+            unsigned entries[256];
+            Table()
+            {
+                for (unsigned n = 0; n < 256; ++n) {
+                    unsigned c = n;
+                    for (int k = 0; k < 8; ++k)
+                        c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                    entries[n] = c;
+                }
+            }
+        };
+        static Table const table;
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i)
+            crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    // Adler-32 of size bytes; zlib stream checksum.
+    unsigned adler32(unsigned char const * data, size_t size)
+    {
+        unsigned a = 1, b = 0;
+        while (size > 0) {
+            // 5552 bytes is the longest run whose sums cannot overflow.
+            size_t block = std::min<size_t>(size, 5552);
+            for (size_t i = 0; i < block; ++i) {
+                a += data[i];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+            data += block;
+            size -= block;
         }
-        std::string toString(Layout const & layout) const
+        return (b << 16) | a;
+    }
+
+    // Appends a zlib stream of data to out: greedy LZ77 over a 32K window
+    //  with one hash probe per position, coded with the fixed Huffman tables.
+    //  Filtered rows of flat chart areas reduce to a few bytes each without
+    //  building dynamic tables.
+    void deflateFixed(unsigned char const * data, size_t size, std::string & out)
+    {
+        // Huffman codes are sent most significant bit first, so the tables
+        //  hold them bit-reversed for the little-endian bit buffer.
+        struct Codes
         {
-            std::stringstream ss;
-            ss << elemStart("polyline");
+            unsigned short literal[288];
+            unsigned char literal_bits[288];
+            unsigned char distance[30];
+            Codes()
+            {
+                for (unsigned symbol = 0; symbol < 288; ++symbol) {
+                    if (symbol < 144)
+                        assign(symbol, 0x30 + symbol, 8);
+                    else if (symbol < 256)
+                        assign(symbol, 0x190 + symbol - 144, 9);
+                    else if (symbol < 280)
+                        assign(symbol, symbol - 256, 7);
+                    else
+                        assign(symbol, 0xC0 + symbol - 280, 8);
+                }
+                for (unsigned symbol = 0; symbol < 30; ++symbol)
+                    distance[symbol] = static_cast<unsigned char>(reverse(symbol, 5));
+            }
+            void assign(unsigned symbol, unsigned code, unsigned bits)
+            {
+                literal[symbol] = static_cast<unsigned short>(reverse(code, bits));
+                literal_bits[symbol] = static_cast<unsigned char>(bits);
+            }
+            static unsigned reverse(unsigned code, unsigned bits)
+            {
+                unsigned reversed = 0;
+                for (unsigned i = 0; i < bits; ++i)
+                    reversed |= ((code >> i) & 1) << (bits - 1 - i);
+                return reversed;
+            }
+        };
+        static Codes const codes;
+        static unsigned short const length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27,
+            31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        static unsigned char const length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+            3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        static unsigned short const distance_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97,
+            129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+        static unsigned char const distance_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+            7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
 
-            ss << "points=\"";
-            for (unsigned i = 0; i < points.size(); ++i)
-                ss << translateX(points[i].x, layout) << "," << translateY(points[i].y, layout) << " ";
-            ss << "\" ";
+        unsigned long long bits = 0;
+        unsigned bit_count = 0;
+        auto put = [&](unsigned value, unsigned count) {
+            bits |= static_cast<unsigned long long>(value) << bit_count;
+            bit_count += count;
+            while (bit_count >= 8) {
+                out += static_cast<char>(bits & 0xFF);
+                bits >>= 8;
+                bit_count -= 8;
+            }
+        };
+        auto hash = [data](size_t i) {
+            unsigned key = (unsigned(data[i]) << 16) | (unsigned(data[i + 1]) << 8) | data[i + 2];
+            return (key * 2654435761u) >> 17;
+        };
 
-            ss << fill.toString(layout) << stroke.toString(layout) << emptyElemEnd();
-            return ss.str();
+        out += '\x78';
+        out += '\x01';
+        // One final block with fixed codes.
+        put(1, 1);
+        put(1, 2);
+        std::vector<long> head(1 << 15, -1);
+        size_t i = 0;
+        while (i < size) {
+            size_t length = 0;
+            size_t distance = 0;
+            if (i + 3 <= size) {
+                unsigned h = hash(i);
+                long candidate = head[h];
+                head[h] = static_cast<long>(i);
+                if (candidate >= 0 && i - candidate <= 32768) {
+                    size_t limit = std::min<size_t>(258, size - i);
+                    while (length < limit && data[candidate + length] == data[i + length])
+                        ++length;
+                    distance = i - candidate;
+                }
+            }
+            if (length < 3) {
+                put(codes.literal[data[i]], codes.literal_bits[data[i]]);
+                ++i;
+                continue;
+            }
+
+            unsigned code = std::upper_bound(length_base, length_base + 29, length) - length_base - 1;
+            put(codes.literal[257 + code], codes.literal_bits[257 + code]);
+            put(static_cast<unsigned>(length - length_base[code]), length_extra[code]);
+            code = std::upper_bound(distance_base, distance_base + 30, distance) - distance_base - 1;
+            put(codes.distance[code], 5);
+            put(static_cast<unsigned>(distance - distance_base[code]), distance_extra[code]);
+            for (size_t j = i + 1; j < i + length && j + 3 <= size; ++j)
+                head[hash(j)] = static_cast<long>(j);
+            i += length;
         }
-        void offset(Point const & offset)
-        {
-            for (unsigned i = 0; i < points.size(); ++i) {
-                points[i].x += offset.x;
-                points[i].y += offset.y;
+        put(codes.literal[256], codes.literal_bits[256]);
+        if (bit_count)
+            put(0, 8 - bit_count);
+
+        unsigned checksum = adler32(data, size);
+        for (int shift = 24; shift >= 0; shift -= 8)
+            out += static_cast<char>((checksum >> shift) & 0xFF);
+    }
+
+    // PNG file of a width x height image of straight (not premultiplied)
+    //  RGBA bytes, rows top to bottom.  Each row gets whichever of the None,
+    //  Sub and Up filters leaves the smallest residuals.
+    std::string encodePng(unsigned width, unsigned height, unsigned char const * rgba)
+    {
+        size_t const row_size = size_t(width) * 4;
+        std::vector<unsigned char> filtered((row_size + 1) * height);
+        std::vector<unsigned char> candidates[3];
+        for (unsigned f = 0; f < 3; ++f)
+            candidates[f].resize(row_size);
+        for (unsigned y = 0; y < height; ++y) {
+            unsigned char const * row = rgba + y * row_size;
+            unsigned char const * above = y ? row - row_size : 0;
+            unsigned long sums[3] = { 0, 0, 0 };
+            for (size_t x = 0; x < row_size; ++x) {
+                unsigned char left = x >= 4 ? row[x - 4] : 0;
+                unsigned char up = above ? above[x] : 0;
+                candidates[0][x] = row[x];
+                candidates[1][x] = static_cast<unsigned char>(row[x] - left);
+                candidates[2][x] = static_cast<unsigned char>(row[x] - up);
+                for (unsigned f = 0; f < 3; ++f)
+                    sums[f] += std::abs(static_cast<signed char>(candidates[f][x]));
             }
+            unsigned best = static_cast<unsigned>(std::min_element(sums, sums + 3) - sums);
+            unsigned char * line = &filtered[y * (row_size + 1)];
+            line[0] = static_cast<unsigned char>(best);
+            std::copy(candidates[best].begin(), candidates[best].end(), line + 1);
         }
-        std::vector<Point> points;
-    };
 
-    class Text : public Shape
+        std::string png("\x89PNG\r\n\x1a\n", 8);
+        auto chunk = [&png](char const * type, std::string const & data) {
+            std::string body(type, 4);
+            body += data;
+            for (int shift = 24; shift >= 0; shift -= 8)
+                png += static_cast<char>((data.size() >> shift) & 0xFF);
+            png += body;
+            unsigned crc = crc32(reinterpret_cast<unsigned char const *>(body.data()), body.size());
+            for (int shift = 24; shift >= 0; shift -= 8)
+                png += static_cast<char>((crc >> shift) & 0xFF);
+        };
+        std::string header;
+        for (int shift = 24; shift >= 0; shift -= 8)
+            header += static_cast<char>((width >> shift) & 0xFF);
+        for (int shift = 24; shift >= 0; shift -= 8)
+            header += static_cast<char>((height >> shift) & 0xFF);
+        // 8 bits per channel, RGBA, deflate, adaptive filters, no interlace.
+        header += std::string("\x08\x06\x00\x00\x00", 5);
+        chunk("IHDR", header);
+        std::string data;
+        deflateFixed(filtered.data(), filtered.size(), data);
+        chunk("IDAT", data);
+        chunk("IEND", std::string());
+        return png;
+    }
+
+    class Shape;
+
+    // Anti-aliased software renderer for PNG thumbnails.  Shapes draw
+    //  themselves from their geometry, translated by layout as in the SVG
+    //  output and then scaled by zoom, so no markup is written or parsed.
+    //  Fills use the nonzero rule with exact per-pixel area coverage (signed
+    //  area accumulation, one scanline pass per path); strokes have butt caps
+    //  and, when wider than two pixels, round joins.  Gradient and pattern
+    //  fills and text are not drawn.
+    class Raster
     {
     public:
-        Text(Point const & origin, std::string const & content, Fill const & fill = Fill(),
-             Font const & font = Font(), Stroke const & stroke = Stroke())
-            : Shape(fill, stroke), origin(origin), content(content), font(font) { }
-        std::string toString(Layout const & layout) const
+        Raster(Layout const & layout, double zoom = 1, Color const & background = Color::White)
+            : layout(layout), zoom(zoom),
+            width(static_cast<unsigned>(std::max(1.0, std::ceil(layout.dimensions.width * zoom)))),
+            height(static_cast<unsigned>(std::max(1.0, std::ceil(layout.dimensions.height * zoom))))
         {
-            std::stringstream ss;
-            ss << elemStart("text") << attribute("x", translateX(origin.x, layout))
-                << attribute("y", translateY(origin.y, layout))
-                << fill.toString(layout) << stroke.toString(layout) << font.toString(layout)
-                << ">" << content << elemEnd("text");
-            return ss.str();
+            clear(background);
         }
-        void offset(Point const & offset)
+        Raster & operator<<(Shape const & shape);
+
+        Layout const & getLayout() const { return layout; }
+        unsigned getWidth() const { return width; }
+        unsigned getHeight() const { return height; }
+        void clear(Color const & background)
         {
-            origin.x += offset.x;
-            origin.y += offset.y;
+            pixels.assign(size_t(width) * height, background.getKey() < 0 ? 0 : solid(background.getKey()));
+        }
+        // Straight RGBA of pixel (x, y), packed as 0xRRGGBBAA.
+        unsigned pixel(unsigned x, unsigned y) const
+        {
+            unsigned char rgba[4];
+            unpremultiply(pixels[size_t(y) * width + x], rgba);
+            return (unsigned(rgba[0]) << 24) | (rgba[1] << 16) | (rgba[2] << 8) | rgba[3];
         }
-    private:
-        Point origin;
-        std::string content;
-        Font font;
-    };
 
-    // Sample charting class.
-    class LineChart : public Shape
-    {
-    public:
-        LineChart(Dimensions margin = Dimensions(), double scale = 1,
-                  Stroke const & axis_stroke = Stroke(.5, Color::Purple))
-            : axis_stroke(axis_stroke), margin(margin), scale(scale) { }
-        LineChart & operator<<(Polyline const & polyline)
+        // Outline through points in native space, back to the first point
+        //  when closed; filled (as if closed) and then stroked.
+        void drawPath(std::vector<Point> const & points, bool closed, Fill const & fill, Stroke const & stroke)
         {
-            if (polyline.points.empty())
-                return *this;
+            size_t const count = points.size();
+            if (fill.getColor().getKey() >= 0 && count >= 3) {
+                for (size_t i = 0; i < count; ++i)
+                    addEdge(scaled(points[i]), scaled(points[(i + 1) % count]));
+                paint(fill.getColor().getKey());
+            }
 
-            polylines.push_back(polyline);
-            return *this;
+            double stroke_width = stroke.getWidth() < 0 ? 0 : translateScale(stroke.getWidth(), layout) * zoom;
+            if (stroke_width <= 0 || stroke.getColor().getKey() < 0 || count < 2)
+                return;
+            double half = stroke_width / 2;
+            for (size_t i = 0; i + 1 < count || (closed && i < count); ++i)
+                addSegment(scaled(points[i]), scaled(points[(i + 1) % count]), half);
+            if (stroke_width > 2)
+                for (size_t i = closed ? 0 : 1; i < (closed ? count : count - 1); ++i)
+                    addDisk(scaled(points[i]), half);
+            paint(stroke.getColor().getKey());
         }
-        std::string toString(Layout const & layout) const
+        void drawEllipse(Point const & center, double radius_x, double radius_y, Fill const & fill,
+            Stroke const & stroke)
         {
-            if (polylines.empty())
-                return "";
-
-            std::string ret;
-            for (unsigned i = 0; i < polylines.size(); ++i)
-                ret += polylineToString(polylines[i], layout);
+            unsigned steps = circleSteps(std::max(radius_x, radius_y) * zoom);
+            double const grow = areaCorrection(steps);
+            outline.clear();
+            for (unsigned i = 0; i < steps; ++i) {
+                double angle = 2 * pi() * i / steps;
+                outline.push_back(Point(center.x + radius_x * grow * std::cos(angle),
+                    center.y + radius_y * grow * std::sin(angle)));
+            }
+            drawPath(outline, true, fill, stroke);
+        }
 
-            return ret + axisString(layout);
+        std::string toPng() const
+        {
+            std::vector<unsigned char> rgba(pixels.size() * 4);
+            for (size_t i = 0; i < pixels.size(); ++i)
+                unpremultiply(pixels[i], &rgba[i * 4]);
+            return encodePng(width, height, rgba.data());
         }
-        void offset(Point const & offset)
+        bool savePng(std::string const & file_name) const
         {
-            for (unsigned i = 0; i < polylines.size(); ++i)
-                polylines[i].offset(offset);
+            std::string png = toPng();
+            int fd = createFile(file_name);
+            if (fd < 0)
+                return false;
+            bool ok = writeAll(fd, png.data(), png.size());
+            return close(fd) == 0 && ok;
         }
     private:
-        Stroke axis_stroke;
-        Dimensions margin;
-        double scale;
-        std::vector<Polyline> polylines;
-
-        optional<Dimensions> getDimensions() const
+        struct Edge
         {
-            if (polylines.empty())
-                return optional<Dimensions>();
+            Point from;
+            Point to;
+        };
 
-            optional<Point> min = getMinPoint(polylines[0].points);
-            optional<Point> max = getMaxPoint(polylines[0].points);
-            for (unsigned i = 0; i < polylines.size(); ++i) {
-                if (getMinPoint(polylines[i].points)->x < min->x)
-                    min->x = getMinPoint(polylines[i].points)->x;
-                if (getMinPoint(polylines[i].points)->y < min->y)
-                    min->y = getMinPoint(polylines[i].points)->y;
-                if (getMaxPoint(polylines[i].points)->x > max->x)
-                    max->x = getMaxPoint(polylines[i].points)->x;
-                if (getMaxPoint(polylines[i].points)->y > max->y)
-                    max->y = getMaxPoint(polylines[i].points)->y;
-            }
+        Layout layout;
+        double zoom;
+        unsigned width;
+        unsigned height;
+        // Premultiplied RGBA, packed red in the low byte.
+        std::vector<unsigned> pixels;
+        // Edges of the path being built, in pixels.
+        std::vector<Edge> edges;
+        std::vector<float> accumulation;
+        std::vector<unsigned char> coverage;
+        std::vector<Point> outline;
 
-            return optional<Dimensions>(Dimensions(max->x - min->x, max->y - min->y));
+        static double pi()
+        {
+            return 3.14159265358979323846;
         }
-        std::string axisString(Layout const & layout) const
+        Point scaled(Point const & point) const
         {
-            optional<Dimensions> dimensions = getDimensions();
-            if (!dimensions)
-                return "";
+            return Point(point.x * zoom, point.y * zoom);
+        }
+        static unsigned solid(int key)
+        {
+            return 0xFF000000u | ((key & 0xFF) << 16) | (key & 0xFF00) | ((key >> 16) & 0xFF);
+        }
+        static void unpremultiply(unsigned pixel, unsigned char * rgba)
+        {
+            unsigned alpha = pixel >> 24;
+            for (int c = 0; c < 3; ++c) {
+                unsigned value = (pixel >> (8 * c)) & 0xFF;
+                rgba[c] = static_cast<unsigned char>(alpha ? std::min(255u, (value * 255 + alpha / 2) / alpha) : 0);
+            }
+            rgba[3] = static_cast<unsigned char>(alpha);
+        }
+        // Vertices for a circle of radius pixels whose chords stray at most
+        //  an eighth of a pixel from the arc.
+        static unsigned circleSteps(double radius)
+        {
+            if (radius <= 0.125)
+                return 8;
+            double steps = std::ceil(pi() / std::acos(1 - 0.125 / radius));
+            return static_cast<unsigned>(std::min(1024.0, std::max(8.0, steps)));
+        }
+        // Radius factor giving a regular polygon of steps vertices the area
+        //  of its circle, so flattening does not shrink small dots.
+        static double areaCorrection(unsigned steps)
+        {
+            return std::sqrt(2 * pi() / (steps * std::sin(2 * pi() / steps)));
+        }
+        void addEdge(Point const & from, Point const & to)
+        {
+            Edge edge = { from, to };
+            edges.push_back(edge);
+        }
+        // Rectangle of half width half around the segment.  Like the disks
+        //  below it winds clockwise whatever the segment direction, so
+        //  overlapping pieces add up instead of cancelling.
+        void addSegment(Point const & from, Point const & to, double half)
+        {
+            double dx = to.x - from.x, dy = to.y - from.y;
+            double length = std::sqrt(dx * dx + dy * dy);
+            if (length == 0)
+                return;
+            Point normal(-dy / length * half, dx / length * half);
+            Point corners[4] = { Point(from.x + normal.x, from.y + normal.y), Point(to.x + normal.x, to.y + normal.y),
+                Point(to.x - normal.x, to.y - normal.y), Point(from.x - normal.x, from.y - normal.y) };
+            for (int i = 0; i < 4; ++i)
+                addEdge(corners[i], corners[(i + 1) % 4]);
+        }
+        void addDisk(Point const & center, double radius)
+        {
+            unsigned steps = circleSteps(radius);
+            radius *= areaCorrection(steps);
+            Point previous(center.x + radius, center.y);
+            for (unsigned i = 1; i <= steps; ++i) {
+                double angle = -2 * pi() * i / steps;
+                Point next(center.x + radius * std::cos(angle), center.y + radius * std::sin(angle));
+                addEdge(previous, next);
+                previous = next;
+            }
+        }
+        // Composites the path built so far with an opaque color at each
+        //  pixel's coverage, and starts a new path.
+        void paint(int key)
+        {
+            Box box;
+            for (size_t i = 0; i < edges.size(); ++i) {
+                box.include(edges[i].from.x, edges[i].from.y);
+                box.include(edges[i].to.x, edges[i].to.y);
+            }
+            int left = static_cast<int>(std::max(0.0, std::floor(box.min_x)));
+            int top = static_cast<int>(std::max(0.0, std::floor(box.min_y)));
+            int right = static_cast<int>(std::min<double>(width, std::ceil(box.max_x)));
+            int bottom = static_cast<int>(std::min<double>(height, std::ceil(box.max_y)));
+            if (edges.empty() || left >= right || top >= bottom) {
+                edges.clear();
+                return;
+            }
 
-            // Make the axis 10% wider and higher than the data points.
-            double width = dimensions->width * 1.1;
-            double height = dimensions->height * 1.1;
+            // One spare column on the right takes the area of edges pinned
+            //  to the border.
+            int const columns = right - left, rows = bottom - top;
+            size_t const stride = columns + 2;
+            accumulation.assign(stride * rows, 0.0f);
+            for (size_t i = 0; i < edges.size(); ++i)
+                clipEdge(edges[i].from.x - left, edges[i].from.y - top, edges[i].to.x - left,
+                    edges[i].to.y - top, columns, rows, stride);
+            edges.clear();
 
-            // Draw the axis.
-            Polyline axis(Color::Transparent, axis_stroke);
-            axis << Point(margin.width, margin.height + height) << Point(margin.width, margin.height)
-                << Point(margin.width + width, margin.height);
+            unsigned const color = solid(key);
+            coverage.resize(columns);
+            for (int y = 0; y < rows; ++y) {
+                float const * cells = &accumulation[y * stride];
+                float sum = 0;
+                for (int x = 0; x < columns; ++x) {
+                    sum += cells[x];
+                    float area = std::fabs(sum);
+                    coverage[x] = area >= 1 ? 255 : static_cast<unsigned char>(area * 255 + 0.5f);
+                }
+                fillSpan(&pixels[size_t(top + y) * width + left], columns, color);
+            }
+        }
+        // Fully covered runs are plain fills, which the compiler turns into
+        //  vector stores; edge pixels are blended one by one.
+        void fillSpan(unsigned * row, int columns, unsigned color)
+        {
+            for (int x = 0; x < columns;) {
+                unsigned alpha = coverage[x];
+                if (alpha == 255) {
+                    int end = x + 1;
+                    while (end < columns && coverage[end] == 255)
+                        ++end;
+                    std::fill(row + x, row + end, color);
+                    x = end;
+                    continue;
+                }
+                if (alpha) {
+                    unsigned blended = 0;
+                    for (int c = 0; c < 32; c += 8) {
+                        unsigned source = (color >> c) & 0xFF, target = (row[x] >> c) & 0xFF;
+                        blended |= ((source * alpha + target * (255 - alpha) + 127) / 255) << c;
+                    }
+                    row[x] = blended;
+                }
+                ++x;
+            }
+        }
+        // Clips an edge to the rows of the region and pins the parts left
+        //  or right of it to the border, where they still add the winding
+        //  they contribute to the pixels beyond.
+        void clipEdge(double x0, double y0, double x1, double y1, int columns, int rows, size_t stride)
+        {
+            if (y0 == y1 || std::max(y0, y1) <= 0 || std::min(y0, y1) >= rows)
+                return;
+            double const dxdy = (x1 - x0) / (y1 - y0);
+            if (y0 < 0 || y1 < 0) {
+                double & x = y0 < 0 ? x0 : x1;
+                double & y = y0 < 0 ? y0 : y1;
+                x -= y * dxdy;
+                y = 0;
+            }
+            if (y0 > rows || y1 > rows) {
+                double & x = y0 > rows ? x0 : x1;
+                double & y = y0 > rows ? y0 : y1;
+                x -= (y - rows) * dxdy;
+                y = rows;
+            }
 
-            return axis.toString(layout);
+            double cuts[4] = { 0, 1, 1, 1 };
+            unsigned count = 1;
+            for (int border = 0; border < 2; ++border) {
+                double t = ((border ? columns : 0) - x0) / (x1 - x0);
+                if (t > 0 && t < 1)
+                    cuts[count++] = t;
+            }
+            std::sort(cuts, cuts + count);
+            cuts[count] = 1;
+            for (unsigned i = 0; i < count; ++i) {
+                double ax = x0 + (x1 - x0) * cuts[i], ay = y0 + (y1 - y0) * cuts[i];
+                double bx = x0 + (x1 - x0) * cuts[i + 1], by = y0 + (y1 - y0) * cuts[i + 1];
+                accumulate(std::min<double>(columns, std::max(0.0, ax)), ay,
+                    std::min<double>(columns, std::max(0.0, bx)), by, stride, rows);
+            }
         }
-        std::string polylineToString(Polyline const & polyline, Layout const & layout) const
+        // Adds the signed area the edge covers to each cell it crosses, and
+        //  the remainder to the next cell, so a running sum along a row gives
+        //  each pixel's coverage.
+        void accumulate(double x0, double y0, double x1, double y1, size_t stride, int rows)
         {
-            Polyline shifted_polyline = polyline;
-            shifted_polyline.offset(Point(margin.width, margin.height));
+            if (y0 == y1)
+                return;
+            double direction = 1;
+            if (y0 > y1) {
+                std::swap(x0, x1);
+                std::swap(y0, y1);
+                direction = -1;
+            }
+            double const dxdy = (x1 - x0) / (y1 - y0);
+            double const min_x = std::min(x0, x1), max_x = std::max(x0, x1);
+            double x = x0;
+            int const last = std::min(rows, static_cast<int>(std::ceil(y1)));
+            for (int y = static_cast<int>(y0); y < last; ++y) {
+                float * cells = &accumulation[y * stride];
+                double bottom = std::min<double>(y + 1, y1);
+                double dy = bottom - std::max<double>(y, y0);
+                // Kept inside the edge's extent, and so inside the region.
+                double next = std::min(max_x, std::max(min_x, x0 + dxdy * (bottom - y0)));
+                double d = dy * direction;
+                double low = std::min(x, next), high = std::max(x, next);
+                double low_floor = std::floor(low);
+                int low_cell = static_cast<int>(low_floor);
+                int high_cell = static_cast<int>(std::ceil(high));
+                if (high_cell <= low_cell + 1) {
+                    // Within one cell: split by the mean x inside it.
+                    double middle = 0.5 * (x + next) - low_floor;
+                    cells[low_cell] += static_cast<float>(d - d * middle);
+                    cells[low_cell + 1] += static_cast<float>(d * middle);
+                }
+                else {
+                    double s = 1 / (high - low);
+                    double low_fraction = low - low_floor;
+                    double a0 = 0.5 * s * (1 - low_fraction) * (1 - low_fraction);
+                    double high_fraction = high - high_cell + 1;
+                    double am = 0.5 * s * high_fraction * high_fraction;
+                    cells[low_cell] += static_cast<float>(d * a0);
+                    if (high_cell == low_cell + 2)
+                        cells[low_cell + 1] += static_cast<float>(d * (1 - a0 - am));
+                    else {
+                        double a1 = s * (1.5 - low_fraction);
+                        cells[low_cell + 1] += static_cast<float>(d * (a1 - a0));
+                        for (int cell = low_cell + 2; cell < high_cell - 1; ++cell)
+                            cells[cell] += static_cast<float>(d * s);
+                        double a2 = a1 + (high_cell - low_cell - 3) * s;
+                        cells[high_cell - 1] += static_cast<float>(d * (1 - a2 - am));
+                    }
+                    cells[high_cell] += static_cast<float>(d * am);
+                }
+                x = next;
+            }
+        }
+    };
+
+    class Shape : public Serializeable
+    {
+    public:
+        Shape(Fill const & fill = Fill(), Stroke const & stroke = Stroke())
+            : fill(fill), stroke(stroke) { }
+        virtual ~Shape() { }
+        virtual std::string toString(Layout const & layout) const = 0;
+        virtual void offset(Point const & offset) = 0;
+        // Bounding box in native space, used by Document to cull invisible shapes.
+        //  Shapes that cannot tell their extent are never culled.
+        virtual Box getBounds(Layout const &) const { return Box::unbounded(); }
+        // Draws the shape into raster; shapes without a raster form draw nothing.
+        virtual void rasterize(Raster &) const { }
+    protected:
+        Fill fill;
+        Stroke stroke;
 
-            std::vector<Circle> vertices;
-            for (unsigned i = 0; i < shifted_polyline.points.size(); ++i)
-                vertices.push_back(Circle(shifted_polyline.points[i], getDimensions()->height / 30.0, Color::Black));
+        // Presentation attributes, or a class reference when the layout interns styles.
+        void writeStyle(Writer & out, Layout const & layout, bool with_fill = true, Font const * font = 0) const
+        {
+            if (layout.style_sheet) {
+                out.attribute("class", layout.style_sheet->intern(with_fill ? &fill : 0, stroke, font, layout));
+                return;
+            }
 
-            return shifted_polyline.toString(layout) + vectorToString(vertices, layout);
+            if (with_fill)
+                fill.serialize(out, layout);
+            stroke.serialize(out, layout);
+            if (font)
+                font->serialize(out, layout);
         }
     };
 
-    class Document
+    Raster & Raster::operator<<(Shape const & shape)
     {
-    public:
-        Document(std::string const & file_name, Layout layout = Layout())
-            : file_name(file_name), layout(layout) { }
+        shape.rasterize(*this);
+        return *this;
+    }
 
-        Document & operator<<(Shape const & shape)
+    template <typename T>
+    std::string vectorToString(std::vector<T> collection, Layout const & layout)
+    {
+        std::string combination_str;
+        for (unsigned i = 0; i < collection.size(); ++i)
+            combination_str += collection[i].toString(layout);
+
+        return combination_str;
+    }
+    template <typename T>
+    Box pointsBounds(std::vector<BasicPoint<T> > const & points, Layout const & layout)
+    {
+        Box box;
+        for (unsigned i = 0; i < points.size(); ++i)
+            box.include(translateX(points[i].x, layout), translateY(points[i].y, layout));
+        return box;
+    }
+
+    class Circle : public Shape
+    {
+    public:
+        Circle(Point const & center, double diameter, Fill const & fill,
+            Stroke const & stroke = Stroke())
+            : Shape(fill, stroke), center(center), radius(diameter / 2) { }
+        std::string toString(Layout const & layout) const
         {
-            body_nodes_str += shape.toString(layout);
-            return *this;
+            return serializeToString(*this, layout);
         }
-        std::string toString() const
+        void serialize(Writer & out, Layout const & layout) const
         {
-            std::stringstream ss;
-            ss << "<?xml " << attribute("version", "1.0") << attribute("standalone", "no")
-                << "?>\n<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" "
-                << "\"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n<svg "
-                << attribute("width", layout.dimensions.width, "px")
-                << attribute("height", layout.dimensions.height, "px")
-                << attribute("xmlns", "http://www.w3.org/2000/svg")
-                << attribute("version", "1.1") << ">\n" << body_nodes_str << elemEnd("svg");
-            return ss.str();
+            out << "\t<circle ";
+            out.attribute("cx", translateX(center.x, layout))
+                .attribute("cy", translateY(center.y, layout))
+                .attribute("r", translateScale(radius, layout));
+            writeStyle(out, layout);
+            out << "/>\n";
         }
-        bool save() const
+        void offset(Point const & offset)
         {
-            std::ofstream ofs(file_name.c_str());
-            if (!ofs.good())
-                return false;
-
-            ofs << toString();
-            ofs.close();
-            return true;
+            center.x += offset.x;
+            center.y += offset.y;
+        }
+        Box getBounds(Layout const & layout) const
+        {
+            double x = translateX(center.x, layout), y = translateY(center.y, layout);
+            double r = translateScale(radius, layout) + stroke.getOverhang(layout);
+            return Box(x - r, y - r, x + r, y + r);
+        }
+        void rasterize(Raster & raster) const
+        {
+            Layout const & layout = raster.getLayout();
+            double r = translateScale(radius, layout);
+            raster.drawEllipse(Point(translateX(center.x, layout), translateY(center.y, layout)), r, r,
+                fill, stroke);
         }
     private:
-        std::string file_name;
-        Layout layout;
-
-        std::string body_nodes_str;
+        Point center;
+        double radius;
     };
+
+    class Elipse : public Shape
+    {
+    public:
+        Elipse(Point const & center, double width, double height,
+            Fill const & fill = Fill(), Stroke const & stroke = Stroke())
+            : Shape(fill, stroke), center(center), radius_width(width / 2),
+            radius_height(height / 2) { }
+        std::string toString(Layout const & layout) const
+        {
+            return serializeToString(*this, layout);
+        }
+        void serialize(Writer & out, Layout const & layout) const
+        {
+            out << "\t<ellipse ";
+            out.attribute("cx", translateX(center.x, layout))
+                .attribute("cy", translateY(center.y, layout))
+                .attribute("rx", translateScale(radius_width, layout))
+                .attribute("ry", translateScale(radius_height, layout));
+            writeStyle(out, layout);
+            out << "/>\n";
+        }
+        void offset(Point const & offset)
+        {
+            center.x += offset.x;
+            center.y += offset.y;
+        }
+        Box getBounds(Layout const & layout) const
+        {
+            double x = translateX(center.x, layout), y = translateY(center.y, layout);
+            double rx = translateScale(radius_width, layout) + stroke.getOverhang(layout);
+            double ry = translateScale(radius_height, layout) + stroke.getOverhang(layout);
+            return Box(x - rx, y - ry, x + rx, y + ry);
+        }
+        void rasterize(Raster & raster) const
+        {
+            Layout const & layout = raster.getLayout();
+            raster.drawEllipse(Point(translateX(center.x, layout), translateY(center.y, layout)),
+                translateScale(radius_width, layout), translateScale(radius_height, layout), fill, stroke);
+        }
+    private:
+        Point center;
+        double radius_width;
+        double radius_height;
+    };
+
+    class Rectangle : public Shape
+    {
+    public:
+        Rectangle(Point const & edge, double width, double height,
+            Fill const & fill = Fill(), Stroke const & stroke = Stroke())
+            : Shape(fill, stroke), edge(edge), width(width),
+            height(height) { }
+        std::string toString(Layout const & layout) const
+        {
+            return serializeToString(*this, layout);
+        }
+        void serialize(Writer & out, Layout const & layout) const
+        {
+            out << "\t<rect ";
+            out.attribute("x", translateX(edge.x, layout))
+                .attribute("y", translateY(edge.y, layout))
+                .attribute("width", translateScale(width, layout))
+                .attribute("height", translateScale(height, layout));
+            writeStyle(out, layout);
+            out << "/>\n";
+        }
+        void offset(Point const & offset)
+        {
+            edge.x += offset.x;
+            edge.y += offset.y;
+        }
+        Box getBounds(Layout const & layout) const
+        {
+            // Mirrors toString: the rect is drawn right and down from the translated edge.
+            double x = translateX(edge.x, layout), y = translateY(edge.y, layout);
+            return Box(x, y, x + translateScale(width, layout), y + translateScale(height, layout))
+                .padded(stroke.getOverhang(layout));
+        }
+        void rasterize(Raster & raster) const
+        {
+            Layout const & layout = raster.getLayout();
+            double x = translateX(edge.x, layout), y = translateY(edge.y, layout);
+            double right = x + translateScale(width, layout), bottom = y + translateScale(height, layout);
+            std::vector<Point> corners;
+            corners.push_back(Point(x, y));
+            corners.push_back(Point(right, y));
+            corners.push_back(Point(right, bottom));
+            corners.push_back(Point(x, bottom));
+            raster.drawPath(corners, true, fill, stroke);
+        }
+    private:
+        Point edge;
+        double width;
+        double height;
+    };
+
+    class Line : public Shape
+    {
+    public:
+        Line(Point const & start_point, Point const & end_point,
+            Stroke const & stroke = Stroke())
+            : Shape(Fill(), stroke), start_point(start_point),
+            end_point(end_point) { }
+        std::string toString(Layout const & layout) const
+        {
+            return serializeToString(*this, layout);
+        }
+        void serialize(Writer & out, Layout const & layout) const
+        {
+            out << "\t<line ";
+            out.attribute("x1", translateX(start_point.x, layout))
+                .attribute("y1", translateY(start_point.y, layout))
+                .attribute("x2", translateX(end_point.x, layout))
+                .attribute("y2", translateY(end_point.y, layout));
+            writeStyle(out, layout, false);
+            out << "/>\n";
+        }
+        void offset(Point const & offset)
+        {
+            start_point.x += offset.x;
+            start_point.y += offset.y;
+
+            end_point.x += offset.x;
+            end_point.y += offset.y;
+        }
+        Box getBounds(Layout const & layout) const
+        {
+            Box box;
+            box.include(translateX(start_point.x, layout), translateY(start_point.y, layout));
+            box.include(translateX(end_point.x, layout), translateY(end_point.y, layout));
+            return box.padded(stroke.getOverhang(layout));
+        }
+        void rasterize(Raster & raster) const
+        {
+            Layout const & layout = raster.getLayout();
+            std::vector<Point> ends;
+            ends.push_back(Point(translateX(start_point.x, layout), translateY(start_point.y, layout)));
+            ends.push_back(Point(translateX(end_point.x, layout), translateY(end_point.y, layout)));
+            raster.drawPath(ends, false, fill, stroke);
+        }
+    private:
+        Point start_point;
+        Point end_point;
+    };
+
+    // Base64 of size bytes into out, which must have room for
+    //  (size + 2) / 3 * 4 characters.  Every 12 input bits map to two output
+    //  characters through one lookup in a 4096-entry table, half the lookups
+    //  of the textbook loop and no branches outside the tail.
+    void encodeBase64(unsigned char const * in, size_t size, char * out)
+    {
+        static char const alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        struct Pairs
+        {
+            char entries[4096][2];
+            Pairs()
+            {
+                for (unsigned i = 0; i < 4096; ++i) {
+                    entries[i][0] = alphabet[i >> 6];
+                    entries[i][1] = alphabet[i & 63];
+                }
+            }
+        };
+        static Pairs const pairs;
+
+        size_t i = 0;
+        for (; i + 3 <= size; i += 3, out += 4) {
+            unsigned bits = (unsigned(in[i]) << 16) | (unsigned(in[i + 1]) << 8) | in[i + 2];
+            std::memcpy(out, pairs.entries[bits >> 12], 2);
+            std::memcpy(out + 2, pairs.entries[bits & 0xFFF], 2);
+        }
+        if (i < size) {
+            unsigned bits = unsigned(in[i]) << 16;
+            if (i + 1 < size)
+                bits |= unsigned(in[i + 1]) << 8;
+            std::memcpy(out, pairs.entries[bits >> 12], 2);
+            out[2] = i + 1 < size ? alphabet[(bits >> 6) & 63] : '=';
+            out[3] = '=';
+        }
+    }
+
+    // Bitmap embedded as a base64 data: URI, placed like a Rectangle.  The
+    //  file's size is taken when the image is created; its content is read
+    //  only when the image is serialized, mapped and encoded block by block
+    //  straight into the output, so a large image costs no heap copy of the
+    //  file or of its encoding.  A file that shrinks or disappears after the
+    //  image is created is zero-padded to the recorded size.  Added to a
+    //  Document with <<, the image is encoded at save time, not into the body.
+    class Image : public Shape
+    {
+    public:
+        Image(Point const & edge, double width, double height, std::string const & file_name,
+            std::string const & mime_type = std::string())
+            : edge(edge), width(width), height(height), file_name(file_name),
+            mime_type(mime_type.empty() ? mimeType(file_name) : mime_type), file_size(0)
+        {
+            struct stat st;
+            if (stat(file_name.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+                file_size = st.st_size;
+        }
+        std::string toString(Layout const & layout) const
+        {
+            return serializeToString(*this, layout);
+        }
+        void serialize(Writer & out, Layout const & layout) const
+        {
+            streamTo(out, layout);
+        }
+        // As serialize, into any output offering extend(size), room for size
+        //  bytes at the end (null while only counting), and commit(), called
+        //  once that room is filled.  The payload goes in 64KB pieces.
+        template <typename Output>
+        void streamTo(Output & out, Layout const & layout) const
+        {
+            Writer counter;
+            writeOpening(counter, layout);
+            char * at = out.extend(counter.size());
+            if (at) {
+                Writer writer(at);
+                writeOpening(writer, layout);
+            }
+            out.commit();
+
+            // Counting passes, where extend gives null, never open the file.
+            size_t const block = 3 * 16 * 1024;
+            Mapping mapping(file_name, file_size, out.extend(0) != 0);
+            for (size_t done = 0; done < file_size; done += block) {
+                size_t size = std::min(block, file_size - done);
+                char * encoded = out.extend((size + 2) / 3 * 4);
+                if (encoded) {
+                    if (done + size <= mapping.length)
+                        encodeBase64(mapping.data + done, size, encoded);
+                    else {
+                        std::vector<unsigned char> padded(size);
+                        if (done < mapping.length)
+                            std::copy(mapping.data + done, mapping.data + mapping.length, padded.begin());
+                        encodeBase64(padded.data(), size, encoded);
+                    }
+                }
+                out.commit();
+            }
+
+            std::string const closing = "\" " + emptyElemEnd();
+            at = out.extend(closing.size());
+            if (at)
+                std::copy(closing.begin(), closing.end(), at);
+            out.commit();
+        }
+        void offset(Point const & offset)
+        {
+            edge.x += offset.x;
+            edge.y += offset.y;
+        }
+        Box getBounds(Layout const & layout) const
+        {
+            double x = translateX(edge.x, layout), y = translateY(edge.y, layout);
+            return Box(x, y, x + translateScale(width, layout), y + translateScale(height, layout));
+        }
+    private:
+        // Read-only mapping of the first length bytes of a file, if wanted.
+        struct Mapping
+        {
+            Mapping(std::string const & file_name, size_t size, bool wanted) : data(0), length(0)
+            {
+                int fd = wanted && size ? open(file_name.c_str(), O_RDONLY) : -1;
+                if (fd < 0)
+                    return;
+                struct stat st;
+                if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                    size_t mapped = std::min<size_t>(size, st.st_size);
+                    void * address = mmap(0, mapped, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (address != MAP_FAILED) {
+                        madvise(address, mapped, MADV_SEQUENTIAL);
+                        data = static_cast<unsigned char const *>(address);
+                        length = mapped;
+                    }
+                }
+                close(fd);
+            }
+            ~Mapping()
+            {
+                if (data)
+                    munmap(const_cast<unsigned char *>(data), length);
+            }
+            unsigned char const * data;
+            size_t length;
+        };
+
+        Point edge;
+        double width;
+        double height;
+        std::string file_name;
+        std::string mime_type;
+        size_t file_size;
+
+        static std::string mimeType(std::string const & file_name)
+        {
+            std::string extension = file_name.substr(file_name.find_last_of('.') + 1);
+            for (size_t i = 0; i < extension.size(); ++i)
+                extension[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(extension[i])));
+            if (extension == "png")
+                return "image/png";
+            if (extension == "jpg" || extension == "jpeg")
+                return "image/jpeg";
+            if (extension == "gif")
+                return "image/gif";
+            if (extension == "webp")
+                return "image/webp";
+            if (extension == "svg")
+                return "image/svg+xml";
+            return "application/octet-stream";
+        }
+        // Everything up to the payload.  xlink is declared on the element, as
+        //  SVG 1.1 viewers need it and the root does not declare it.
+        void writeOpening(Writer & out, Layout const & layout) const
+        {
+            out << "\t<image ";
+            out.attribute("x", translateX(edge.x, layout))
+                .attribute("y", translateY(edge.y, layout))
+                .attribute("width", translateScale(width, layout))
+                .attribute("height", translateScale(height, layout))
+                .attribute("xmlns:xlink", "http://www.w3.org/1999/xlink");
+            out << "xlink:href=\"data:" << mime_type << ";base64,";
+        }
+    };
+
+    // Visvalingam-Whyatt simplification: repeatedly drops the vertex whose
+    //  triangle with its neighbours has the smallest area, until every
+    //  remaining triangle is at least min_area.  A heap keeps this O(n log n);
+    //  a vertex's area never drops below that of a vertex removed before it,
+    //  so the result does not depend on removal order among small triangles.
+    //  Closed rings keep at least three vertices, open lines their endpoints.
+    template <typename T>
+    void simplifyPoints(std::vector<BasicPoint<T> > & points, double min_area, bool closed)
+    {
+        size_t const count = points.size();
+        size_t const keep = closed ? 3 : 2;
+        if (count <= keep)
+            return;
+
+        std::vector<size_t> prev(count), next(count);
+        for (size_t i = 0; i < count; ++i) {
+            prev[i] = i ? i - 1 : count - 1;
+            next[i] = i + 1 < count ? i + 1 : 0;
+        }
+        std::vector<double> area(count, std::numeric_limits<double>::infinity());
+        std::vector<bool> removed(count, false);
+
+        struct Entry
+        {
+            double area;
+            size_t index;
+            bool operator<(Entry const & other) const { return area > other.area; }
+        };
+        std::priority_queue<Entry> heap;
+        auto triangle = [&](size_t i) {
+            BasicPoint<T> const & a = points[prev[i]];
+            BasicPoint<T> const & b = points[i];
+            BasicPoint<T> const & c = points[next[i]];
+            return std::fabs((static_cast<double>(b.x) - a.x) * (static_cast<double>(c.y) - a.y)
+                - (static_cast<double>(c.x) - a.x) * (static_cast<double>(b.y) - a.y)) / 2;
+        };
+        for (size_t i = 0; i < count; ++i)
+            if (closed || (i != 0 && i + 1 != count)) {
+                area[i] = triangle(i);
+                heap.push(Entry{ area[i], i });
+            }
+
+        size_t left = count;
+        while (left > keep && !heap.empty()) {
+            Entry entry = heap.top();
+            heap.pop();
+            // Stale entries are skipped; a vertex is queued again when its area changes.
+            if (removed[entry.index] || entry.area != area[entry.index])
+                continue;
+            if (entry.area >= min_area)
+                break;
+
+            size_t i = entry.index;
+            removed[i] = true;
+            --left;
+            next[prev[i]] = next[i];
+            prev[next[i]] = prev[i];
+            size_t const neighbours[] = { prev[i], next[i] };
+            for (unsigned n = 0; n < 2; ++n) {
+                size_t j = neighbours[n];
+                if (!closed && (j == 0 || j + 1 == count))
+                    continue;
+                area[j] = std::max(triangle(j), entry.area);
+                heap.push(Entry{ area[j], j });
+            }
+        }
+
+        size_t out = 0;
+        for (size_t i = 0; i < count; ++i)
+            if (!removed[i])
+                points[out++] = points[i];
+        points.resize(out);
+    }
+
+    template <typename T>
+    class BasicPolygon : public Shape
+    {
+    public:
+        BasicPolygon(Fill const & fill = Fill(), Stroke const & stroke = Stroke())
+            : Shape(fill, stroke) { }
+        BasicPolygon(Stroke const & stroke = Stroke()) : Shape(Color::Transparent, stroke) { }
+        BasicPolygon & operator<<(BasicPoint<T> const & point)
+        {
+            points.push_back(point);
+            return *this;
+        }
+        std::string toString(Layout const & layout) const
+        {
+            return serializeToString(*this, layout);
+        }
+        void serialize(Writer & out, Layout const & layout) const
+        {
+            out << "\t<polygon ";
+
+            out << "points=\"";
+            for (unsigned i = 0; i < points.size(); ++i)
+                out << translateX(points[i].x, layout) << ',' << translateY(points[i].y, layout) << ' ';
+            out << "\" ";
+
+            writeStyle(out, layout);
+            out << "/>\n";
+        }
+        void offset(Point const & offset)
+        {
+            for (unsigned i = 0; i < points.size(); ++i) {
+                points[i].x = static_cast<T>(points[i].x + offset.x);
+                points[i].y = static_cast<T>(points[i].y + offset.y);
+            }
+        }
+        Box getBounds(Layout const & layout) const
+        {
+            return pointsBounds(points, layout).padded(stroke.getOverhang(layout));
+        }
+        void rasterize(Raster & raster) const
+        {
+            Layout const & layout = raster.getLayout();
+            std::vector<Point> native(points.size());
+            for (unsigned i = 0; i < points.size(); ++i)
+                native[i] = Point(translateX(points[i].x, layout), translateY(points[i].y, layout));
+            raster.drawPath(native, true, fill, stroke);
+        }
+        // Drops vertices whose removal changes the outline by less than about
+        //  tolerance pixels once drawn at layout's scale.
+        BasicPolygon & simplify(double tolerance, Layout const & layout)
+        {
+            double user_tolerance = tolerance / layout.scale;
+            simplifyPoints(points, user_tolerance * user_tolerance, true);
+            return *this;
+        }
+        size_t size() const { return points.size(); }
+    private:
+        std::vector<BasicPoint<T> > points;
+    };
+    typedef BasicPolygon<double> Polygon;
+
+    // Simplifies every polygon as BasicPolygon::simplify does, on threads
+    //  workers (0: one per core).
+    template <typename T>
+    void simplifyPolygons(std::vector<BasicPolygon<T> > & polygons, double tolerance,
+        Layout const & layout, unsigned threads = 0)
+    {
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> workers;
+        for (unsigned i = 0; i < std::min<size_t>(threads, polygons.size()); ++i)
+            workers.push_back(std::thread([&]() {
+                for (size_t p = next++; p < polygons.size(); p = next++)
+                    polygons[p].simplify(tolerance, layout);
+            }));
+        for (unsigned i = 0; i < workers.size(); ++i)
+            workers[i].join();
+    }
+
+    template <typename T>
+    class BasicPolyline : public Shape
+    {
+    public:
+        BasicPolyline(Fill const & fill = Fill(), Stroke const & stroke = Stroke())
+            : Shape(fill, stroke) { }
+        BasicPolyline(Stroke const & stroke = Stroke()) : Shape(Color::Transparent, stroke) { }
+        BasicPolyline(std::vector<BasicPoint<T> > const & points,
+            Fill const & fill = Fill(), Stroke const & stroke = Stroke())
+            : Shape(fill, stroke), points(points) { }
+        // Vertices are read from the mapped series at serialization time;
+        //  points added with << follow them.
+        BasicPolyline(MappedSeries const & series,
+            Fill const & fill = Fill(), Stroke const & stroke = Stroke())
+            : Shape(fill, stroke), series(series) { }
+        BasicPolyline & operator<<(BasicPoint<T> const & point)
+        {
+            points.push_back(point);
+            return *this;
+        }
+        std::string toString(Layout const & layout) const
+        {
+            return serializeToString(*this, layout);
+        }
+        void serialize(Writer & out, Layout const & layout) const
+        {
+            writePoints(out, layout, 0);
+        }
+        // As serialize, with every vertex moved by shift; the points are not
+        //  touched, so huge series need no shifted copy.
+        void serialize(Writer & out, Layout const & layout, Point const & shift) const
+        {
+            writePoints(out, layout, &shift);
+        }
+        void offset(Point const & offset)
+        {
+            for (unsigned i = 0; i < points.size(); ++i) {
+                points[i].x = static_cast<T>(points[i].x + offset.x);
+                points[i].y = static_cast<T>(points[i].y + offset.y);
+            }
+            series_offset.x += offset.x;
+            series_offset.y += offset.y;
+        }
+        Box getBounds(Layout const & layout) const
+        {
+            return getBounds(layout, Point());
+        }
+        Box getBounds(Layout const & layout, Point const & shift) const
+        {
+            Box box;
+            for (size_t i = 0, count = size(); i < count; ++i) {
+                Point const point = at(i);
+                box.include(translateX(point.x + shift.x, layout), translateY(point.y + shift.y, layout));
+            }
+            return box.padded(stroke.getOverhang(layout));
+        }
+        void rasterize(Raster & raster) const
+        {
+            rasterize(raster, Point());
+        }
+        void rasterize(Raster & raster, Point const & shift) const
+        {
+            Layout const & layout = raster.getLayout();
+            std::vector<Point> native(size());
+            for (size_t i = 0; i < native.size(); ++i) {
+                Point const point = at(i);
+                native[i] = Point(translateX(point.x + shift.x, layout), translateY(point.y + shift.y, layout));
+            }
+            raster.drawPath(native, false, fill, stroke);
+        }
+        // Vertex count and vertex i, mapped series first.
+        size_t size() const { return series.size() + points.size(); }
+        Point at(size_t i) const
+        {
+            if (i >= series.size())
+                return Point(points[i - series.size()]);
+
+            Point point = series[i];
+            point.x += series_offset.x;
+            point.y += series_offset.y;
+            return point;
+        }
+        std::vector<BasicPoint<T> > points;
+    private:
+        MappedSeries series;
+        Point series_offset;
+
+        void writePoints(Writer & out, Layout const & layout, Point const * shift) const
+        {
+            out << "\t<polyline ";
+
+            out << "points=\"";
+            for (size_t i = 0, count = size(); i < count; ++i) {
+                Point point = at(i);
+                if (shift) {
+                    point.x += shift->x;
+                    point.y += shift->y;
+                }
+                out << translateX(point.x, layout) << ',' << translateY(point.y, layout) << ' ';
+            }
+            out << "\" ";
+
+            writeStyle(out, layout);
+            out << "/>\n";
+        }
+    };
+    typedef BasicPolyline<double> Polyline;
+
+
+    class Text : public Shape
+    {
+    public:
+        Text(Point const & origin, std::string const & content, Fill const & fill = Fill(),
+             Font const & font = Font(), Stroke const & stroke = Stroke())
+            : Shape(fill, stroke), origin(origin), content(content), font(font) { }
+        std::string toString(Layout const & layout) const
+        {
+            return serializeToString(*this, layout);
+        }
+        void serialize(Writer & out, Layout const & layout) const
+        {
+            out << "\t<text ";
+            out.attribute("x", translateX(origin.x, layout))
+                .attribute("y", translateY(origin.y, layout));
+            writeStyle(out, layout, true, &font);
+            out << ">" << content << "</text>\n";
+        }
+        void offset(Point const & offset)
+        {
+            origin.x += offset.x;
+            origin.y += offset.y;
+        }
+        Box getBounds(Layout const & layout) const
+        {
+            // Measured advance; ascent taken as 1em and descent as 0.25em.
+            double x = translateX(origin.x, layout), y = translateY(origin.y, layout);
+            double size = translateScale(font.getSize(), layout);
+            return Box(x, y - size, x + translateScale(measure(content, font), layout), y + size * 0.25)
+                .padded(stroke.getOverhang(layout));
+        }
+    private:
+        Point origin;
+        std::string content;
+        Font font;
+    };
+
+    // Tile of shapes repeated over the filled area.  Children are drawn in a
+    //  top-left tile space of the given dimensions, which the viewBox maps onto
+    //  a tile scaled like the rest of the document.
+    class Pattern : public Definition
+    {
+    public:
+        Pattern(Dimensions const & tile) : tile(tile) { }
+        Pattern & operator<<(Shape const & shape)
+        {
+            children_str += "\t\t" + shape.toString(Layout(tile, Layout::TopLeft));
+            invalidate();
+            return *this;
+        }
+    protected:
+        std::string elementName() const { return "pattern"; }
+        std::string attributeString(Layout const & layout) const
+        {
+            std::stringstream box;
+            box << "0 0 " << tile.width << " " << tile.height;
+            std::stringstream ss;
+            ss << attribute("patternUnits", "userSpaceOnUse") << attribute("x", 0) << attribute("y", 0)
+                << attribute("width", translateScale(tile.width, layout))
+                << attribute("height", translateScale(tile.height, layout))
+                << attribute("viewBox", box.str());
+            return ss.str();
+        }
+        std::string childrenString(Layout const &) const { return children_str; }
+    private:
+        Dimensions tile;
+        std::string children_str;
+    };
+
+    // Sample charting class.
+    template <typename T>
+    class BasicLineChart : public Shape
+    {
+    public:
+        BasicLineChart(Dimensions margin = Dimensions(), double scale = 1,
+                  Stroke const & axis_stroke = Stroke(.5, Color::Purple))
+            : axis_stroke(axis_stroke), margin(margin), scale(scale) { }
+        BasicLineChart & operator<<(BasicPolyline<T> const & polyline)
+        {
+            if (polyline.size() == 0)
+                return *this;
+
+            polylines.push_back(polyline);
+            return *this;
+        }
+        std::string toString(Layout const & layout) const
+        {
+            return serializeToString(*this, layout);
+        }
+        void serialize(Writer & out, Layout const & layout) const
+        {
+            optional<Dimensions> dimensions = getDimensions();
+            if (!dimensions)
+                return;
+
+            // Computed once; every vertex circle is sized from it.
+            Dimensions const data_size(dimensions->width, dimensions->height);
+            for (unsigned i = 0; i < polylines.size(); ++i)
+                writePolyline(out, polylines[i], data_size, layout);
+
+            writeAxis(out, data_size, layout);
+        }
+        void rasterize(Raster & raster) const
+        {
+            optional<Dimensions> dimensions = getDimensions();
+            if (!dimensions)
+                return;
+
+            Point const shift(margin.width, margin.height);
+            for (unsigned i = 0; i < polylines.size(); ++i) {
+                polylines[i].rasterize(raster, shift);
+                for (size_t j = 0, count = polylines[i].size(); j < count; ++j) {
+                    Point const point = polylines[i].at(j);
+                    Circle(Point(point.x + shift.x, point.y + shift.y), dimensions->height / 30.0,
+                        Color::Black).rasterize(raster);
+                }
+            }
+            axis(Dimensions(dimensions->width, dimensions->height)).rasterize(raster);
+        }
+        void offset(Point const & offset)
+        {
+            for (unsigned i = 0; i < polylines.size(); ++i)
+                polylines[i].offset(offset);
+        }
+        Box getBounds(Layout const & layout) const
+        {
+            optional<Dimensions> dimensions = getDimensions();
+            if (!dimensions)
+                return Box();
+
+            // Shifted data points padded by the vertex circles, plus the axis corners.
+            Box box;
+            for (unsigned i = 0; i < polylines.size(); ++i)
+                box.include(polylines[i].getBounds(layout, Point(margin.width, margin.height)));
+            box = box.padded(translateScale(dimensions->height / 60.0, layout));
+            box.include(translateX(margin.width, layout), translateY(margin.height, layout));
+            box.include(translateX(margin.width + dimensions->width * 1.1, layout),
+                translateY(margin.height + dimensions->height * 1.1, layout));
+            return box.padded(axis_stroke.getOverhang(layout));
+        }
+    private:
+        Stroke axis_stroke;
+        Dimensions margin;
+        double scale;
+        std::vector<BasicPolyline<T> > polylines;
+
+        optional<Dimensions> getDimensions() const
+        {
+            if (polylines.empty())
+                return optional<Dimensions>();
+
+            // One pass over every vertex; mapped series are not copied out.
+            Point min = polylines[0].at(0);
+            Point max = min;
+            for (unsigned i = 0; i < polylines.size(); ++i) {
+                for (size_t j = 0, count = polylines[i].size(); j < count; ++j) {
+                    Point const point = polylines[i].at(j);
+                    if (point.x < min.x)
+                        min.x = point.x;
+                    if (point.y < min.y)
+                        min.y = point.y;
+                    if (point.x > max.x)
+                        max.x = point.x;
+                    if (point.y > max.y)
+                        max.y = point.y;
+                }
+            }
+
+            return optional<Dimensions>(Dimensions(max.x - min.x, max.y - min.y));
+        }
+        Polyline axis(Dimensions const & dimensions) const
+        {
+            // Make the axis 10% wider and higher than the data points.
+            double width = dimensions.width * 1.1;
+            double height = dimensions.height * 1.1;
+
+            Polyline axis(Color::Transparent, axis_stroke);
+            axis << Point(margin.width, margin.height + height) << Point(margin.width, margin.height)
+                << Point(margin.width + width, margin.height);
+            return axis;
+        }
+        void writeAxis(Writer & out, Dimensions const & dimensions, Layout const & layout) const
+        {
+            axis(dimensions).serialize(out, layout);
+        }
+        void writePolyline(Writer & out, BasicPolyline<T> const & polyline, Dimensions const & dimensions,
+            Layout const & layout) const
+        {
+            Point const shift(margin.width, margin.height);
+            polyline.serialize(out, layout, shift);
+
+            for (size_t i = 0, count = polyline.size(); i < count; ++i) {
+                Point const point = polyline.at(i);
+                Circle(Point(point.x + shift.x, point.y + shift.y), dimensions.height / 30.0,
+                    Color::Black).serialize(out, layout);
+            }
+        }
+    };
+    typedef BasicLineChart<double> LineChart;
+
+    // Scatter plot from columnar arrays: point i is drawn at (x[i], y[i]) with
+    //  palette[color[i]].  Points are grouped by color once, and each group is
+    //  written as one <path> of small squares or dots, so a million points
+    //  make as many elements as there are colors.  Points whose color index is
+    //  outside the palette are not drawn.
+    class ScatterSeries : public Shape
+    {
+    public:
+        enum Marker { Square, Dot };
+
+        ScatterSeries(std::vector<double> x, std::vector<double> y, std::vector<unsigned> const & color,
+            std::vector<Fill> const & palette, double size = 2, Marker marker = Square,
+            Stroke const & stroke = Stroke())
+            : Shape(Color::Transparent, stroke), x(std::move(x)), y(std::move(y)), palette(palette),
+            size(size), marker(marker)
+        {
+            // Counting sort of point indices by color.
+            size_t count = std::min(std::min(this->x.size(), this->y.size()), color.size());
+            group_start.assign(palette.size() + 1, 0);
+            for (size_t i = 0; i < count; ++i)
+                if (color[i] < palette.size())
+                    ++group_start[color[i] + 1];
+            for (size_t c = 0; c < palette.size(); ++c)
+                group_start[c + 1] += group_start[c];
+            order.resize(group_start.back());
+            std::vector<size_t> fill_at(group_start.begin(), group_start.end() - 1);
+            for (size_t i = 0; i < count; ++i)
+                if (color[i] < palette.size())
+                    order[fill_at[color[i]]++] = static_cast<unsigned>(i);
+        }
+        std::string toString(Layout const & layout) const
+        {
+            return serializeToString(*this, layout);
+        }
+        void serialize(Writer & out, Layout const & layout) const
+        {
+            double const side = translateScale(size, layout);
+            double const half = side / 2;
+            for (size_t c = 0; c < palette.size(); ++c) {
+                if (group_start[c] == group_start[c + 1])
+                    continue;
+
+                out << "\t<path d=\"";
+                for (size_t k = group_start[c]; k < group_start[c + 1]; ++k) {
+                    double const px = translateX(x[order[k]], layout);
+                    double const py = translateY(y[order[k]], layout);
+                    if (marker == Square)
+                        out << 'M' << px - half << ' ' << py - half << 'h' << side << 'v' << side
+                            << 'h' << -side << 'z';
+                    else
+                        out << 'M' << px - half << ' ' << py << 'a' << half << ' ' << half << " 0 1 0 "
+                            << side << " 0a" << half << ' ' << half << " 0 1 0 " << -side << " 0z";
+                }
+                out << "\" ";
+
+                if (layout.style_sheet)
+                    out.attribute("class", layout.style_sheet->intern(&palette[c], stroke, 0, layout));
+                else {
+                    palette[c].serialize(out, layout);
+                    stroke.serialize(out, layout);
+                }
+                out << "/>\n";
+            }
+        }
+        void offset(Point const & offset)
+        {
+            for (size_t i = 0; i < x.size(); ++i)
+                x[i] += offset.x;
+            for (size_t i = 0; i < y.size(); ++i)
+                y[i] += offset.y;
+        }
+        Box getBounds(Layout const & layout) const
+        {
+            Box box;
+            for (size_t k = 0; k < order.size(); ++k)
+                box.include(translateX(x[order[k]], layout), translateY(y[order[k]], layout));
+            return box.padded(translateScale(size, layout) / 2 + stroke.getOverhang(layout));
+        }
+    private:
+        std::vector<double> x;
+        std::vector<double> y;
+        std::vector<Fill> palette;
+        double size;
+        Marker marker;
+        // Points of color c are order[group_start[c]] .. order[group_start[c + 1] - 1].
+        std::vector<unsigned> order;
+        std::vector<size_t> group_start;
+    };
+
+
+    // One SVG animating a scene over frames, instead of a document per frame.
+    //  Every frame adds the same sequence of shapes, typically Rectangles and
+    //  Polylines whose geometry moves.  The first frame is drawn, and each
+    //  attribute that differs in a later frame gets an <animate> child
+    //  listing its values only at the frames where it changes, so output
+    //  grows with the number of changes rather than frames times shapes.
+    //  A frame that lacks a shape leaves it as it was; shapes beyond the
+    //  first frame's count, and shapes that do not serialize to a single
+    //  empty element, are drawn as in the first frame.
+    class Animation : public Shape
+    {
+    public:
+        // Each frame shows for frame_seconds; with interpolate, attributes
+        //  move linearly from frame to frame instead of stepping.  Without
+        //  repeat the animation stops on the last frame.
+        Animation(double frame_seconds = 1, bool interpolate = false, bool repeat = true)
+            : frame_seconds(frame_seconds), interpolate(interpolate), repeat(repeat), frames(1) { }
+        template <typename T>
+        Animation & operator<<(T const & shape)
+        {
+            static_assert(std::is_base_of<Shape, T>::value, "Animation frames hold shapes");
+            frames.back().push_back(std::make_shared<T>(shape));
+            return *this;
+        }
+        // Shapes added from now on belong to the next frame.
+        Animation & nextFrame()
+        {
+            frames.push_back(Frame());
+            return *this;
+        }
+        size_t frameCount() const { return frames.size(); }
+
+        std::string toString(Layout const & layout) const
+        {
+            return serializeToString(*this, layout);
+        }
+        void serialize(Writer & out, Layout const & layout) const
+        {
+            Layout const context = shifted(layout);
+            for (size_t track = 0; track < frames[0].size(); ++track)
+                writeTrack(out, track, context);
+        }
+        // Moves every frame; shapes are shared between copies, so the shift
+        //  is applied through the layout when serializing.
+        void offset(Point const & offset)
+        {
+            shift.x += offset.x;
+            shift.y += offset.y;
+        }
+        Box getBounds(Layout const & layout) const
+        {
+            Layout const context = shifted(layout);
+            Box box;
+            for (size_t frame = 0; frame < frames.size(); ++frame)
+                for (size_t i = 0; i < frames[frame].size() && i < frames[0].size(); ++i)
+                    box.include(frames[frame][i]->getBounds(context));
+            return box;
+        }
+    private:
+        typedef std::vector<std::shared_ptr<Shape const> > Frame;
+        struct Element
+        {
+            std::string name;
+            std::vector<std::pair<std::string, std::string> > attributes;
+        };
+
+        double frame_seconds;
+        bool interpolate;
+        bool repeat;
+        std::vector<Frame> frames;
+        Point shift;
+
+        Layout shifted(Layout const & layout) const
+        {
+            Layout context = layout;
+            context.origin_offset.x += shift.x;
+            context.origin_offset.y += shift.y;
+            return context;
+        }
+        // Splits the output of a shape into its element name and attributes;
+        //  false unless it is a single empty element.
+        static bool parse(std::string const & text, Element & element)
+        {
+            size_t i = text.find_first_not_of(" \t\r\n");
+            if (i == std::string::npos || text[i] != '<')
+                return false;
+            size_t name_end = text.find_first_of(" \t\r\n/>", i + 1);
+            if (name_end == std::string::npos)
+                return false;
+            element.name = text.substr(i + 1, name_end - i - 1);
+            element.attributes.clear();
+            for (i = name_end; ; ) {
+                i = text.find_first_not_of(" \t\r\n", i);
+                if (i == std::string::npos || text[i] == '>')
+                    return false;
+                if (text[i] == '/')
+                    return text.compare(i, 2, "/>") == 0
+                        && text.find_first_not_of(" \t\r\n", i + 2) == std::string::npos;
+                size_t equals = text.find('=', i);
+                if (equals == std::string::npos || equals + 1 >= text.size() || text[equals + 1] != '"')
+                    return false;
+                size_t close = text.find('"', equals + 2);
+                if (close == std::string::npos)
+                    return false;
+                element.attributes.push_back(std::make_pair(text.substr(i, equals - i),
+                    text.substr(equals + 2, close - equals - 2)));
+                i = close + 1;
+            }
+        }
+        void writeTrack(Writer & out, size_t track, Layout const & context) const
+        {
+            std::string const first = serializeToString(*frames[0][track], context);
+            Element element;
+            if (frames.size() < 2 || !parse(first, element)) {
+                out << first;
+                return;
+            }
+
+            // values[a][f]: attribute a in frame f.
+            size_t const count = frames.size();
+            std::vector<std::vector<std::string> > values(element.attributes.size());
+            for (size_t a = 0; a < values.size(); ++a) {
+                values[a].reserve(count);
+                values[a].push_back(element.attributes[a].second);
+            }
+            Element next;
+            for (size_t frame = 1; frame < count; ++frame) {
+                bool present = track < frames[frame].size()
+                    && parse(serializeToString(*frames[frame][track], context), next) && next.name == element.name;
+                for (size_t a = 0; a < values.size(); ++a) {
+                    std::string const * value = &values[a].back();
+                    for (size_t b = 0; present && b < next.attributes.size(); ++b) {
+                        // Attributes come in the same order frame to frame.
+                        size_t candidate = (a + b) % next.attributes.size();
+                        if (next.attributes[candidate].first == element.attributes[a].first) {
+                            value = &next.attributes[candidate].second;
+                            break;
+                        }
+                    }
+                    values[a].push_back(*value);
+                }
+            }
+
+            std::vector<size_t> changing;
+            for (size_t a = 0; a < values.size(); ++a)
+                if (std::count(values[a].begin(), values[a].end(), values[a][0]) != static_cast<long>(count))
+                    changing.push_back(a);
+            if (changing.empty()) {
+                out << first;
+                return;
+            }
+
+            out << "\t<" << element.name << ' ';
+            for (size_t a = 0; a < element.attributes.size(); ++a)
+                out << element.attributes[a].first << "=\"" << element.attributes[a].second << "\" ";
+            out << ">\n";
+            for (size_t c = 0; c < changing.size(); ++c)
+                writeAnimate(out, element.attributes[changing[c]].first, values[changing[c]]);
+            out << "\t" << elemEnd(element.name);
+        }
+        // Stepped animations list a value where it changes, at the start of
+        //  that frame; interpolated ones also keep the frame before a change,
+        //  so a held value stays still until the next frame begins to move.
+        void writeAnimate(Writer & out, std::string const & name, std::vector<std::string> const & values) const
+        {
+            size_t const count = values.size();
+            std::vector<size_t> keys;
+            for (size_t f = 0; f < count; ++f)
+                if (f == 0 || values[f] != values[f - 1]
+                    || (interpolate && (f + 1 == count || values[f] != values[f + 1])))
+                    keys.push_back(f);
+
+            double const span = interpolate ? count - 1 : count;
+            out << "\t\t<animate ";
+            out.attribute("attributeName", name);
+            out << "values=\"";
+            for (size_t k = 0; k < keys.size(); ++k)
+                out << (k ? ";" : "") << values[keys[k]];
+            out << "\" keyTimes=\"";
+            for (size_t k = 0; k < keys.size(); ++k)
+                out << (k ? ";" : "") << keys[k] / span;
+            out << "\" ";
+            out.attribute("dur", span * frame_seconds, "s")
+                .attribute("calcMode", interpolate ? "linear" : "discrete");
+            if (repeat)
+                out.attribute("repeatCount", "indefinite");
+            else
+                out.attribute("fill", "freeze");
+            out << emptyElemEnd();
+        }
+    };
+
+#if __cplusplus >= 201703L
+    // A shape held by value.  Functions below dispatch on the alternative
+    //  with qualified calls, so no virtual call is made.
+    typedef std::variant<Circle, Elipse, Rectangle, Line, Polygon, Polyline, Text, Image> ShapeValue;
+
+    void serialize(ShapeValue const & shape, Writer & out, Layout const & layout)
+    {
+        std::visit([&](auto const & value) {
+            typedef typename std::decay<decltype(value)>::type Type;
+            value.Type::serialize(out, layout);
+        }, shape);
+    }
+    Box getBounds(ShapeValue const & shape, Layout const & layout)
+    {
+        return std::visit([&](auto const & value) {
+            typedef typename std::decay<decltype(value)>::type Type;
+            return value.Type::getBounds(layout);
+        }, shape);
+    }
+    void offset(ShapeValue & shape, Point const & offset)
+    {
+        std::visit([&](auto & value) {
+            typedef typename std::decay<decltype(value)>::type Type;
+            value.Type::offset(offset);
+        }, shape);
+    }
+    void rasterize(ShapeValue const & shape, Raster & raster)
+    {
+        std::visit([&](auto const & value) {
+            typedef typename std::decay<decltype(value)>::type Type;
+            value.Type::rasterize(raster);
+        }, shape);
+    }
+    // The held shape, for interfaces that take any Shape.
+    Shape const & asShape(ShapeValue const & shape)
+    {
+        return std::visit([](auto const & value) -> Shape const & { return value; }, shape);
+    }
+
+    // Shapes stored contiguously by value, for scenes that are kept and
+    //  rendered more than once.  Adding a shape allocates nothing beyond its
+    //  own point vector, iteration walks one array, and serialization,
+    //  bounds and offset dispatch on the variant index instead of the
+    //  vtable.  Document appends a list shape by shape, each culled on its
+    //  own.
+    class ShapeList
+    {
+    public:
+        typedef std::vector<ShapeValue>::const_iterator const_iterator;
+
+        template <typename T>
+        ShapeList & operator<<(T const & shape)
+        {
+            shapes.emplace_back(shape);
+            return *this;
+        }
+        void reserve(size_t size) { shapes.reserve(size); }
+        void clear() { shapes.clear(); }
+        size_t size() const { return shapes.size(); }
+        bool empty() const { return shapes.empty(); }
+        ShapeValue const & operator[](size_t i) const { return shapes[i]; }
+        ShapeValue & operator[](size_t i) { return shapes[i]; }
+        const_iterator begin() const { return shapes.begin(); }
+        const_iterator end() const { return shapes.end(); }
+
+        std::string toString(Layout const & layout) const
+        {
+            Writer counter;
+            serialize(counter, layout);
+            std::string str(counter.size(), '\0');
+            if (!str.empty()) {
+                Writer writer(&str[0]);
+                serialize(writer, layout);
+            }
+            return str;
+        }
+        void serialize(Writer & out, Layout const & layout) const
+        {
+            for (size_t i = 0; i < shapes.size(); ++i)
+                svg::serialize(shapes[i], out, layout);
+        }
+        void offset(Point const & offset)
+        {
+            for (size_t i = 0; i < shapes.size(); ++i)
+                svg::offset(shapes[i], offset);
+        }
+        Box getBounds(Layout const & layout) const
+        {
+            Box box;
+            for (size_t i = 0; i < shapes.size(); ++i)
+                box.include(svg::getBounds(shapes[i], layout));
+            return box;
+        }
+        void rasterize(Raster & raster) const
+        {
+            for (size_t i = 0; i < shapes.size(); ++i)
+                svg::rasterize(shapes[i], raster);
+        }
+    private:
+        std::vector<ShapeValue> shapes;
+    };
+#endif
+
+    // Uniform grid over a set of boxes.  Boxes are bucketed into every cell they
+    //  overlap so a query only looks at the cells under the query box.  Boxes
+    //  covering too many cells, or with no finite extent, are kept aside and
+    //  always returned as candidates.
+    class SpatialGrid
+    {
+    public:
+        SpatialGrid() : columns(0), rows(0), cell_width(1), cell_height(1) { }
+        void build(std::vector<Box> const & boxes)
+        {
+            extent = Box();
+            for (unsigned i = 0; i < boxes.size(); ++i)
+                if (boxes[i].bounded())
+                    extent.include(boxes[i]);
+
+            cell_start.clear();
+            cell_items.clear();
+            always.clear();
+            columns = rows = 0;
+            if (extent.empty()) {
+                for (unsigned i = 0; i < boxes.size(); ++i)
+                    if (!boxes[i].empty())
+                        always.push_back(i);
+                return;
+            }
+
+            // Roughly one box per cell.
+            unsigned side = static_cast<unsigned>(std::ceil(std::sqrt(static_cast<double>(boxes.size()))));
+            columns = rows = std::max(1u, std::min(side, 1024u));
+            cell_width = std::max(extent.width() / columns, std::numeric_limits<double>::min());
+            cell_height = std::max(extent.height() / rows, std::numeric_limits<double>::min());
+
+            // Counting pass, then fill: cells are stored back to back (CSR layout).
+            std::vector<unsigned> counts(columns * rows + 1, 0);
+            for (int pass = 0; pass < 2; ++pass) {
+                for (unsigned i = 0; i < boxes.size(); ++i) {
+                    if (boxes[i].empty())
+                        continue;
+                    unsigned x0, y0, x1, y1;
+                    if (!boxes[i].bounded() || !cellRange(boxes[i], x0, y0, x1, y1)
+                        || (x1 - x0 + 1) * (y1 - y0 + 1) > max_cells_per_box) {
+                        if (pass == 0)
+                            always.push_back(i);
+                        continue;
+                    }
+                    for (unsigned y = y0; y <= y1; ++y)
+                        for (unsigned x = x0; x <= x1; ++x) {
+                            if (pass == 0)
+                                ++counts[y * columns + x + 1];
+                            else
+                                cell_items[counts[y * columns + x]++] = i;
+                        }
+                }
+                if (pass == 0) {
+                    for (unsigned c = 1; c < counts.size(); ++c)
+                        counts[c] += counts[c - 1];
+                    cell_start = counts;
+                    cell_items.resize(counts.back());
+                }
+            }
+        }
+        // Appends the ids of boxes that may intersect box, sorted and unique.
+        void query(Box const & box, std::vector<unsigned> & ids) const
+        {
+            size_t first = ids.size();
+            ids.insert(ids.end(), always.begin(), always.end());
+            unsigned x0, y0, x1, y1;
+            if (columns && cellRange(box, x0, y0, x1, y1))
+                for (unsigned y = y0; y <= y1; ++y)
+                    for (unsigned x = x0; x <= x1; ++x)
+                        ids.insert(ids.end(), cell_items.begin() + cell_start[y * columns + x],
+                            cell_items.begin() + cell_start[y * columns + x + 1]);
+            std::sort(ids.begin() + first, ids.end());
+            ids.erase(std::unique(ids.begin() + first, ids.end()), ids.end());
+        }
+    private:
+        static const unsigned max_cells_per_box = 64;
+
+        Box extent;
+        unsigned columns;
+        unsigned rows;
+        double cell_width;
+        double cell_height;
+        std::vector<unsigned> cell_start;
+        std::vector<unsigned> cell_items;
+        std::vector<unsigned> always;
+
+        // Cells overlapped by box, clamped to the grid; false if box misses the grid.
+        bool cellRange(Box const & box, unsigned & x0, unsigned & y0, unsigned & x1, unsigned & y1) const
+        {
+            if (!box.intersects(extent))
+                return false;
+            x0 = cellIndex(box.min_x, extent.min_x, cell_width, columns);
+            x1 = cellIndex(box.max_x, extent.min_x, cell_width, columns);
+            y0 = cellIndex(box.min_y, extent.min_y, cell_height, rows);
+            y1 = cellIndex(box.max_y, extent.min_y, cell_height, rows);
+            return true;
+        }
+        static unsigned cellIndex(double value, double origin, double size, unsigned count)
+        {
+            double cell = std::floor((value - origin) / size);
+            if (!(cell > 0))
+                return 0;
+            return cell >= count ? count - 1 : static_cast<unsigned>(cell);
+        }
+    };
+
+    // Greedy, first-come label placement without overlaps.  Accepted boxes are
+    //  bucketed in an unbounded grid of cell_size cells, so a candidate is only
+    //  tested against labels in the cells it covers and laying out n labels
+    //  is O(n).  Boxes are in native space; touching boxes do not overlap.
+    class LabelPlacer
+    {
+    public:
+        explicit LabelPlacer(double cell_size = 32, double spacing = 0)
+            : cell_size(cell_size > 0 ? cell_size : 32), spacing(spacing) { }
+
+        // Accepts box unless it overlaps an accepted one.
+        bool place(Box const & box)
+        {
+            if (box.empty())
+                return false;
+            Box const padded = box.padded(spacing / 2);
+            long long x0, y0, x1, y1;
+            cellRange(padded, x0, y0, x1, y1);
+            bool large = (x1 - x0 + 1) * (y1 - y0 + 1) > max_cells_per_box;
+
+            if (collides(padded, large_boxes))
+                return false;
+            if (large) {
+                for (unsigned i = 0; i < placed_boxes.size(); ++i)
+                    if (overlaps(padded, placed_boxes[i]))
+                        return false;
+            }
+            else
+                for (long long y = y0; y <= y1; ++y)
+                    for (long long x = x0; x <= x1; ++x) {
+                        std::unordered_map<unsigned long long, std::vector<unsigned> >::const_iterator
+                            cell = cells.find(cellKey(x, y));
+                        if (cell != cells.end() && collides(padded, cell->second))
+                            return false;
+                    }
+
+            unsigned id = static_cast<unsigned>(placed_boxes.size());
+            placed_boxes.push_back(padded);
+            if (large)
+                large_boxes.push_back(id);
+            else
+                for (long long y = y0; y <= y1; ++y)
+                    for (long long x = x0; x <= x1; ++x)
+                        cells[cellKey(x, y)].push_back(id);
+            return true;
+        }
+        // Accepts the first candidate that fits; returns its index, or -1.
+        int place(std::vector<Box> const & candidates)
+        {
+            for (unsigned i = 0; i < candidates.size(); ++i)
+                if (place(candidates[i]))
+                    return i;
+            return -1;
+        }
+        bool place(Text const & text, Layout const & layout)
+        {
+            return place(text.getBounds(layout));
+        }
+        // Accepted boxes, grown by half the spacing, in acceptance order.
+        std::vector<Box> const & placed() const { return placed_boxes; }
+        void clear()
+        {
+            cells.clear();
+            placed_boxes.clear();
+            large_boxes.clear();
+        }
+    private:
+        static const long long max_cells_per_box = 64;
+
+        double cell_size;
+        double spacing;
+        std::unordered_map<unsigned long long, std::vector<unsigned> > cells;
+        std::vector<Box> placed_boxes;
+        std::vector<unsigned> large_boxes;
+
+        static bool overlaps(Box const & a, Box const & b)
+        {
+            return a.min_x < b.max_x && b.min_x < a.max_x && a.min_y < b.max_y && b.min_y < a.max_y;
+        }
+        bool collides(Box const & box, std::vector<unsigned> const & ids) const
+        {
+            for (unsigned i = 0; i < ids.size(); ++i)
+                if (overlaps(box, placed_boxes[ids[i]]))
+                    return true;
+            return false;
+        }
+        void cellRange(Box const & box, long long & x0, long long & y0, long long & x1, long long & y1) const
+        {
+            x0 = cellIndex(box.min_x);
+            y0 = cellIndex(box.min_y);
+            x1 = cellIndex(box.max_x);
+            y1 = cellIndex(box.max_y);
+        }
+        long long cellIndex(double value) const
+        {
+            double cell = std::floor(value / cell_size);
+            double const limit = 1e9;
+            return static_cast<long long>(std::max(-limit, std::min(limit, cell)));
+        }
+        static unsigned long long cellKey(long long x, long long y)
+        {
+            return (static_cast<unsigned long long>(x) << 32) ^ static_cast<unsigned long long>(y & 0xffffffffLL);
+        }
+    };
+
+    // Log-scale latency histogram.  Bucket i counts samples of at most
+    //  2^(i + 7) ns (128ns up to about 1s); the last bucket is unbounded.
+    struct Histogram
+    {
+        static const unsigned bucket_count = 25;
+
+        Histogram() : count(0), sum_ns(0) { std::fill(buckets, buckets + bucket_count, 0ULL); }
+        void record(unsigned long long ns)
+        {
+            unsigned bucket = 0;
+            while (bucket + 1 < bucket_count && ns > upperBound(bucket))
+                ++bucket;
+            ++buckets[bucket];
+            ++count;
+            sum_ns += ns;
+        }
+        static unsigned long long upperBound(unsigned bucket) { return 128ULL << bucket; }
+
+        unsigned long long count;
+        unsigned long long sum_ns;
+        unsigned long long buckets[bucket_count];
+    };
+
+    // Opt-in render instrumentation: element counts, bytes and serialization
+    //  latency per shape type, plus write and fsync latency of Document::save.
+    //  Attach with Document::setStats; one instance may be shared by documents
+    //  on several threads.
+    class RenderStats
+    {
+    public:
+        struct Entry
+        {
+            Entry() : bytes(0) { }
+            unsigned long long bytes;
+            Histogram latency;
+        };
+
+        void recordShape(std::type_info const & type, size_t bytes, unsigned long long ns)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Entry & entry = shapes[std::type_index(type)];
+            entry.bytes += bytes;
+            entry.latency.record(ns);
+        }
+        void recordWrite(size_t bytes, unsigned long long ns)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            writes.bytes += bytes;
+            writes.latency.record(ns);
+        }
+        void recordSync(unsigned long long ns)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            syncs.latency.record(ns);
+        }
+        void reset()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            shapes.clear();
+            writes = Entry();
+            syncs = Entry();
+        }
+        // {"shapes":{"Circle":{"count":..,"bytes":..,"seconds":..,"buckets":[..]}},"write":{..},"fsync":{..}}
+        std::string toJson() const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::stringstream ss;
+            ss << "{\"shapes\":{";
+            std::map<std::string, Entry> named = namedShapes();
+            for (std::map<std::string, Entry>::const_iterator it = named.begin(); it != named.end(); ++it) {
+                if (it != named.begin())
+                    ss << ",";
+                ss << "\"" << it->first << "\":";
+                writeJson(ss, it->second);
+            }
+            ss << "},\"write\":";
+            writeJson(ss, writes);
+            ss << ",\"fsync\":";
+            writeJson(ss, syncs);
+            ss << "}\n";
+            return ss.str();
+        }
+        // Prometheus text exposition format.
+        std::string toPrometheus(std::string const & prefix = "svg_render") const
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::stringstream ss;
+            std::map<std::string, Entry> named = namedShapes();
+            ss << "# TYPE " << prefix << "_elements_total counter\n";
+            for (std::map<std::string, Entry>::const_iterator it = named.begin(); it != named.end(); ++it)
+                ss << prefix << "_elements_total{shape=\"" << it->first << "\"} " << it->second.latency.count << "\n";
+            ss << "# TYPE " << prefix << "_bytes_total counter\n";
+            for (std::map<std::string, Entry>::const_iterator it = named.begin(); it != named.end(); ++it)
+                ss << prefix << "_bytes_total{shape=\"" << it->first << "\"} " << it->second.bytes << "\n";
+            ss << "# TYPE " << prefix << "_written_bytes_total counter\n";
+            ss << prefix << "_written_bytes_total " << writes.bytes << "\n";
+            ss << "# TYPE " << prefix << "_seconds histogram\n";
+            for (std::map<std::string, Entry>::const_iterator it = named.begin(); it != named.end(); ++it)
+                writePrometheus(ss, prefix, "shape=\"" + it->first + "\"", it->second.latency);
+            writePrometheus(ss, prefix, "stage=\"write\"", writes.latency);
+            writePrometheus(ss, prefix, "stage=\"fsync\"", syncs.latency);
+            return ss.str();
+        }
+    private:
+        mutable std::mutex mutex;
+        std::unordered_map<std::type_index, Entry> shapes;
+        Entry writes;
+        Entry syncs;
+
+        // Unqualified, demangled class name, e.g. "Circle" or "Polyline".
+        static std::string shapeName(std::type_index const & type)
+        {
+            std::string name = type.name();
+#ifdef __GNUG__
+            int status = 0;
+            char * demangled = abi::__cxa_demangle(type.name(), 0, 0, &status);
+            if (status == 0 && demangled)
+                name = demangled;
+            std::free(demangled);
+#endif
+            size_t scope = name.rfind("::", name.find('<'));
+            if (scope != std::string::npos)
+                name.erase(0, scope + 2);
+            // The double instantiations report under their typedef names.
+            std::string const basic = "Basic", coordinate = "<double>";
+            if (name.compare(0, basic.size(), basic) == 0 && name.size() > coordinate.size()
+                && name.compare(name.size() - coordinate.size(), coordinate.size(), coordinate) == 0)
+                name = name.substr(basic.size(), name.size() - basic.size() - coordinate.size());
+            return name;
+        }
+        std::map<std::string, Entry> namedShapes() const
+        {
+            std::map<std::string, Entry> named;
+            for (std::unordered_map<std::type_index, Entry>::const_iterator it = shapes.begin();
+                it != shapes.end(); ++it)
+                named[shapeName(it->first)] = it->second;
+            return named;
+        }
+        static void writeJson(std::stringstream & ss, Entry const & entry)
+        {
+            ss << "{\"count\":" << entry.latency.count << ",\"bytes\":" << entry.bytes
+                << ",\"seconds\":" << entry.latency.sum_ns / 1e9 << ",\"buckets\":[";
+            for (unsigned i = 0; i < Histogram::bucket_count; ++i)
+                ss << (i ? "," : "") << entry.latency.buckets[i];
+            ss << "]}";
+        }
+        static void writePrometheus(std::stringstream & ss, std::string const & prefix,
+            std::string const & label, Histogram const & histogram)
+        {
+            unsigned long long cumulative = 0;
+            for (unsigned i = 0; i < Histogram::bucket_count; ++i) {
+                cumulative += histogram.buckets[i];
+                ss << prefix << "_seconds_bucket{" << label << ",le=\"";
+                if (i + 1 < Histogram::bucket_count)
+                    ss << Histogram::upperBound(i) / 1e9;
+                else
+                    ss << "+Inf";
+                ss << "\"} " << cumulative << "\n";
+            }
+            ss << prefix << "_seconds_sum{" << label << "} " << histogram.sum_ns / 1e9 << "\n";
+            ss << prefix << "_seconds_count{" << label << "} " << histogram.count << "\n";
+        }
+    };
+
+    unsigned long long elapsedNanoseconds(std::chrono::steady_clock::time_point const & start)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Streaming SVG minifier for the text Document produces.  Input may arrive
+    //  in arbitrary pieces; complete tokens are rewritten as they are seen:
+    //  whitespace between elements and inside tags and attribute values is
+    //  dropped or collapsed, rgb() colors become hex, leading zeros are
+    //  removed from fractions, attributes equal to their SVG default are
+    //  dropped (coordinates only on shapes and text, inherited ones only on
+    //  children of the root, where no ancestor can override them), and runs
+    //  of two or more adjacent <line> elements with identical remaining
+    //  attributes become one <path>.  Declarations, CDATA and text content
+    //  pass through unchanged.
+    class Minifier
+    {
+    public:
+        Minifier() : state(Text), quote(0), tag(0), line_count(0) { }
+
+        void feed(char const * data, size_t size, std::string & out)
+        {
+            char const * const end = data + size;
+            while (data < end) {
+                if (state == Text) {
+                    // memchr is vectorized; text runs are skipped a block at a time.
+                    char const * open = static_cast<char const *>(std::memchr(data, '<', end - data));
+                    if (!open) {
+                        text.append(data, end);
+                        return;
+                    }
+                    flushText(data, open, out);
+                    // Tags wholly inside this piece are rewritten in place; the
+                    //  rest are collected in token first.
+                    char const * close = open + 1 < end && open[1] != '!' ? findTagEnd(open + 1, end) : 0;
+                    if (close) {
+                        processTag(open, close + 1 - open, out);
+                        data = close + 1;
+                        continue;
+                    }
+                    token.assign(1, '<');
+                    state = TagStart;
+                    data = open + 1;
+                }
+                else if (state == TagStart) {
+                    token += *data;
+                    state = *data++ == '!' ? Declaration : Tag;
+                }
+                else if (state == Tag)
+                    data = scanTag(data, end, out);
+                else
+                    data = scanDeclaration(data, end, out);
+            }
+        }
+        // Writes what is held back between elements (pending lines, text),
+        //  so output appended directly after it stays in order.
+        void flush(std::string & out)
+        {
+            if (state == Text)
+                flushText(0, 0, out);
+            flushLines(out);
+        }
+        // Writes anything still held back; call once after the last feed.
+        void finish(std::string & out)
+        {
+            if (state == Text)
+                flushText(0, 0, out);
+            else
+                out += token;
+            flushLines(out);
+            state = Text;
+            token.clear();
+        }
+    private:
+        enum State { Text, TagStart, Tag, Declaration };
+        // Attribute names the rewriting rules care about; X1 to Y2 keep the
+        //  order of a line's coordinates.
+        enum Key { X1, Y1, X2, Y2, Position, Opacity, Fill, Stroke, StrokeWidth, Verbatim, Other };
+        struct Span
+        {
+            size_t begin;
+            size_t end;
+        };
+        struct Attribute
+        {
+            Span key;
+            Span value;
+        };
+
+        State state;
+        char quote;
+        std::string token;
+        std::string text;
+        std::vector<std::string> open_elements;
+        // Tag being rewritten, either in the input or in token.
+        char const * tag;
+        std::vector<Attribute> attributes;
+        std::string value;
+        // Pending run of mergeable lines: coordinates of the first, their shared
+        //  remaining attributes and the path data so far.
+        unsigned line_count;
+        std::string line_coordinates;
+        std::string line_style;
+        std::string line_path;
+        std::string next_coordinates;
+        std::string next_style;
+        std::string points[4];
+
+        // The '>' closing a tag whose name starts at data, or null when the tag
+        //  runs past end.
+        static char const * findTagEnd(char const * data, char const * end)
+        {
+            for (; data < end; ++data) {
+                if (*data == '>')
+                    return data;
+                if (*data == '"' || *data == '\'') {
+                    data = static_cast<char const *>(std::memchr(data + 1, *data, end - data - 1));
+                    if (!data)
+                        return 0;
+                }
+            }
+            return 0;
+        }
+        // Tag bodies are copied a run at a time up to the next quote or '>'.
+        char const * scanTag(char const * data, char const * end, std::string & out)
+        {
+            while (data < end) {
+                if (quote) {
+                    char const * close = static_cast<char const *>(std::memchr(data, quote, end - data));
+                    if (!close) {
+                        token.append(data, end);
+                        return end;
+                    }
+                    token.append(data, close + 1);
+                    data = close + 1;
+                    quote = 0;
+                    continue;
+                }
+                char const * stop = data;
+                while (stop < end && *stop != '"' && *stop != '\'' && *stop != '>')
+                    ++stop;
+                token.append(data, stop);
+                if (stop == end)
+                    return end;
+                token += *stop;
+                if (*stop == '>') {
+                    processTag(token.data(), token.size(), out);
+                    state = Text;
+                    return stop + 1;
+                }
+                quote = *stop;
+                data = stop + 1;
+            }
+            return data;
+        }
+        // <!DOCTYPE ...> or <![CDATA[ ... ]]>, passed through.
+        char const * scanDeclaration(char const * data, char const * end, std::string & out)
+        {
+            for (; data < end; ++data) {
+                char c = *data;
+                token += c;
+                bool cdata = token.size() >= 9 && token.compare(0, 9, "<![CDATA[") == 0;
+                if (!cdata && quote) {
+                    if (c == quote)
+                        quote = 0;
+                }
+                else if (!cdata && (c == '"' || c == '\''))
+                    quote = c;
+                else if (c == '>' && (!cdata || (token.size() >= 12
+                    && token.compare(token.size() - 3, 3, "]]>") == 0))) {
+                    flushLines(out);
+                    out += token;
+                    state = Text;
+                    return data + 1;
+                }
+            }
+            return data;
+        }
+        // Text held back from earlier pieces followed by [data, end).
+        void flushText(char const * data, char const * end, std::string & out)
+        {
+            if (!text.empty()) {
+                text.append(data, end);
+                data = text.data();
+                end = data + text.size();
+            }
+            bool keep = !open_elements.empty()
+                && (open_elements.back() == "text" || open_elements.back() == "tspan");
+            for (char const * c = data; !keep && c < end; ++c)
+                keep = !isSpace(*c);
+            if (keep) {
+                flushLines(out);
+                out.append(data, end);
+            }
+            text.clear();
+        }
+        static bool isSpace(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+        }
+        bool is(Span const & span, char const * str) const
+        {
+            size_t length = std::char_traits<char>::length(str);
+            return span.end - span.begin == length && std::memcmp(tag + span.begin, str, length) == 0;
+        }
+        void processTag(char const * data, size_t size, std::string & out)
+        {
+            tag = data;
+            if (tag[1] == '?') {
+                flushLines(out);
+                out.append(tag, size);
+                return;
+            }
+            if (tag[1] == '/') {
+                flushLines(out);
+                size_t last = size - 1;
+                while (last > 2 && isSpace(tag[last - 1]))
+                    --last;
+                out.append(tag, last) += '>';
+                if (!open_elements.empty())
+                    open_elements.pop_back();
+                return;
+            }
+
+            Span name = { 1, 1 };
+            while (name.end < size && !isSpace(tag[name.end]) && tag[name.end] != '/' && tag[name.end] != '>')
+                ++name.end;
+            bool self_closing = size >= 2 && tag[size - 2] == '/';
+            parseAttributes(name.end, size);
+            bool top_level = open_elements.size() == 1;
+            bool line = self_closing && is(name, "line");
+            // Only on shapes is 0 the default of every coordinate; gradients
+            //  default x2, cx and cy to percentages.
+            bool shape = is(name, "rect") || is(name, "circle") || is(name, "ellipse")
+                || is(name, "line") || is(name, "text");
+
+            if (line) {
+                next_style.clear();
+                next_coordinates.clear();
+                for (unsigned c = 0; c < 4; ++c)
+                    points[c] = "0";
+            }
+            else
+                flushLines(out);
+            // Attributes already in their shortest form are copied in runs
+            //  straight from the tag.
+            size_t copied = 0;
+            size_t copy_end = name.end;
+            for (unsigned a = 0; a < attributes.size(); ++a) {
+                Span const & key = attributes[a].key;
+                Span const & source = attributes[a].value;
+                Key kind = classify(key);
+                shortenValue(kind, source);
+                bool drop = isDefault(kind, top_level, shape);
+                int coordinate = line && kind <= Y2 ? kind : -1;
+                if (coordinate >= 0 && !drop)
+                    points[coordinate] = value;
+                if (!line && !drop && key.begin == copy_end + 1 && tag[copy_end] == ' '
+                    && key.end + 2 == source.begin && tag[key.end] == '=' && tag[key.end + 1] == '"'
+                    && value.size() == source.end - source.begin
+                    && std::memcmp(value.data(), tag + source.begin, value.size()) == 0) {
+                    copy_end = source.end + 1;
+                    continue;
+                }
+                if (!line)
+                    out.append(tag + copied, copy_end - copied);
+                copied = copy_end = source.end + 1;
+                if (drop)
+                    continue;
+                // The original quote is kept: a value may contain the other one.
+                char const quote = tag[source.begin - 1];
+                std::string & destination = !line ? out : coordinate >= 0 ? next_coordinates : next_style;
+                destination += ' ';
+                destination.append(tag + key.begin, key.end - key.begin);
+                (destination += '=') += quote;
+                destination.append(value) += quote;
+            }
+
+            if (line) {
+                if (line_count && next_style != line_style)
+                    flushLines(out);
+                if (!line_count) {
+                    line_style.swap(next_style);
+                    line_coordinates.swap(next_coordinates);
+                    line_path.clear();
+                }
+                line_path.append("M").append(points[0]).append(separator(points[1])).append(points[1])
+                    .append("L").append(points[2]).append(separator(points[3])).append(points[3]);
+                ++line_count;
+                return;
+            }
+
+            out.append(tag + copied, copy_end - copied);
+            if (self_closing)
+                out += "/>";
+            else {
+                out += '>';
+                open_elements.push_back(std::string(tag + name.begin, name.end - name.begin));
+            }
+        }
+        void flushLines(std::string & out)
+        {
+            if (line_count == 1)
+                out.append("<line").append(line_coordinates).append(line_style).append("/>");
+            else if (line_count > 1)
+                out.append("<path d=\"").append(line_path).append("\"").append(line_style).append("/>");
+            line_count = 0;
+        }
+        static char const * separator(std::string const & next)
+        {
+            return !next.empty() && next[0] == '-' ? "" : " ";
+        }
+        void parseAttributes(size_t i, size_t size)
+        {
+            attributes.clear();
+            while (true) {
+                while (i < size && isSpace(tag[i]))
+                    ++i;
+                if (i == size || tag[i] == '/' || tag[i] == '>')
+                    return;
+                size_t key_end = i;
+                while (key_end < size && tag[key_end] != '=' && !isSpace(tag[key_end]))
+                    ++key_end;
+                size_t open = key_end;
+                while (open < size && tag[open] != '"' && tag[open] != '\'')
+                    ++open;
+                if (open == size)
+                    return;
+                char const * close = static_cast<char const *>(std::memchr(tag + open + 1, tag[open], size - open - 1));
+                if (!close)
+                    return;
+                Attribute attribute = { { i, key_end }, { open + 1, size_t(close - tag) } };
+                attributes.push_back(attribute);
+                i = close - tag + 1;
+            }
+        }
+        Key classify(Span const & key) const
+        {
+            char const * name = tag + key.begin;
+            switch (key.end - key.begin) {
+            case 1:
+                return *name == 'x' || *name == 'y' ? Position : Other;
+            case 2:
+                if ((name[0] == 'x' || name[0] == 'y') && (name[1] == '1' || name[1] == '2'))
+                    return Key((name[0] == 'y') + (name[1] == '2') * 2);
+                if (name[0] == 'c' && (name[1] == 'x' || name[1] == 'y'))
+                    return Position;
+                return is(key, "id") ? Verbatim : Other;
+            case 4:
+                return is(key, "fill") ? Fill : is(key, "href") ? Verbatim : Other;
+            case 6:
+                return is(key, "stroke") ? Stroke : Other;
+            case 7:
+                return is(key, "opacity") ? Opacity : is(key, "version") ? Verbatim : Other;
+            case 12:
+                return is(key, "stroke-width") ? StrokeWidth : is(key, "fill-opacity") ? Opacity : Other;
+            case 14:
+                return is(key, "stroke-opacity") ? Opacity : Other;
+            default:
+                return is(key, "class") || is(key, "font-family") || is(key, "xlink:href")
+                    || (key.end - key.begin >= 5 && std::memcmp(tag + key.begin, "xmlns", 5) == 0) ? Verbatim : Other;
+            }
+        }
+        bool isDefault(Key kind, bool top_level, bool shape) const
+        {
+            if (kind <= Position)
+                return shape && value == "0";
+            if (kind == Opacity)
+                return value == "1";
+            return top_level && ((kind == Fill && value == "#000") || (kind == Stroke && value == "none")
+                || (kind == StrokeWidth && value == "1"));
+        }
+        // Shortened form of the attribute value at span, into value.
+        void shortenValue(Key kind, Span const & span)
+        {
+            value.assign(tag + span.begin, span.end - span.begin);
+            if (kind == Verbatim)
+                return;
+            if (hexColor())
+                return;
+
+            // Collapse whitespace and drop the zero of "0.5" where a number starts.
+            size_t out = 0;
+            for (size_t i = 0; i < value.size(); ++i) {
+                char c = value[i];
+                if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+                    if (out && value[out - 1] != ' ')
+                        value[out++] = ' ';
+                    continue;
+                }
+                char prev = out ? value[out - 1] : ' ';
+                bool starts_number = !(prev >= '0' && prev <= '9') && !(prev >= 'a' && prev <= 'z')
+                    && !(prev >= 'A' && prev <= 'Z') && prev != '.' && prev != '#' && prev != '_';
+                if (c == '0' && starts_number && i + 2 < value.size() && value[i + 1] == '.'
+                    && value[i + 2] >= '0' && value[i + 2] <= '9')
+                    continue;
+                value[out++] = c;
+            }
+            if (out && value[out - 1] == ' ')
+                --out;
+            value.resize(out);
+        }
+        // Rewrites an rgb(r,g,b) value as #rgb when every channel repeats a
+        //  digit, else #rrggbb.
+        bool hexColor()
+        {
+            if (value.size() < 10 || value.compare(0, 4, "rgb(") != 0 || value[value.size() - 1] != ')')
+                return false;
+            int channels[3];
+            size_t i = 4;
+            for (unsigned c = 0; c < 3; ++c) {
+                int channel = 0;
+                size_t first = i;
+                while (i < value.size() && value[i] >= '0' && value[i] <= '9' && i - first < 3)
+                    channel = channel * 10 + (value[i++] - '0');
+                char expected = c < 2 ? ',' : ')';
+                if (i == first || channel > 255 || i >= value.size() || value[i] != expected)
+                    return false;
+                channels[c] = channel;
+                ++i;
+            }
+            if (i != value.size())
+                return false;
+
+            static char const digits[] = "0123456789abcdef";
+            bool short_form = channels[0] % 17 == 0 && channels[1] % 17 == 0 && channels[2] % 17 == 0;
+            value.assign(1, '#');
+            for (unsigned c = 0; c < 3; ++c) {
+                if (short_form)
+                    value += digits[channels[c] / 17];
+                else {
+                    value += digits[channels[c] >> 4];
+                    value += digits[channels[c] & 15];
+                }
+            }
+            return true;
+        }
+    };
+
+    // Minified copy of svg text.
+    std::string minify(std::string const & svg)
+    {
+        std::string out;
+        out.reserve(svg.size());
+        Minifier minifier;
+        minifier.feed(svg.data(), svg.size(), out);
+        minifier.finish(out);
+        return out;
+    }
+
+    // Dedicated I/O thread behind Document::saveAsync.  At most depth
+    //  documents are pending (being written or queued); submit blocks while
+    //  the queue is full, so the producer stays at most depth documents ahead
+    //  of the disk.  Written buffers are handed back through acquireBuffer, so
+    //  with the default depth of 2 two buffers alternate between rendering
+    //  and writing.  The destructor finishes every pending write.
+    class AsyncWriter
+    {
+    public:
+        explicit AsyncWriter(size_t depth = 2)
+            : depth(std::max<size_t>(1, depth)), pending(0), stopping(false),
+            worker(&AsyncWriter::run, this) { }
+        ~AsyncWriter()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            not_empty.notify_one();
+            worker.join();
+        }
+
+        // An empty string, with the capacity of a previously written buffer
+        //  when one is free.
+        std::string acquireBuffer()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (spare.empty())
+                return std::string();
+            std::string buffer = std::move(spare.back());
+            spare.pop_back();
+            return buffer;
+        }
+        std::future<bool> submit(std::string const & file_name, std::string content,
+            bool sync = false, RenderStats * stats = 0)
+        {
+            Job job;
+            job.file_name = file_name;
+            job.content = std::move(content);
+            job.sync = sync;
+            job.stats = stats;
+            std::future<bool> result = job.done.get_future();
+
+            std::unique_lock<std::mutex> lock(mutex);
+            not_full.wait(lock, [this]() { return pending < depth; });
+            ++pending;
+            queue.push_back(std::move(job));
+            lock.unlock();
+            not_empty.notify_one();
+            return result;
+        }
+        // Blocks until every submitted document is written.
+        void wait()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            drained.wait(lock, [this]() { return pending == 0; });
+        }
+    private:
+        struct Job
+        {
+            std::string file_name;
+            std::string content;
+            bool sync;
+            RenderStats * stats;
+            std::promise<bool> done;
+        };
+
+        size_t depth;
+        size_t pending;
+        bool stopping;
+        std::deque<Job> queue;
+        std::vector<std::string> spare;
+        std::mutex mutex;
+        std::condition_variable not_full;
+        std::condition_variable not_empty;
+        std::condition_variable drained;
+        std::thread worker;
+
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                not_empty.wait(lock, [this]() { return stopping || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                Job job = std::move(queue.front());
+                queue.pop_front();
+                lock.unlock();
+
+                bool ok = write(job);
+                job.content.clear();
+
+                lock.lock();
+                if (spare.size() < depth)
+                    spare.push_back(std::move(job.content));
+                --pending;
+                not_full.notify_one();
+                if (pending == 0)
+                    drained.notify_all();
+                job.done.set_value(ok);
+            }
+        }
+        static bool write(Job const & job)
+        {
+            int fd = createFile(job.file_name);
+            if (fd < 0)
+                return false;
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            bool ok = writeAll(fd, job.content.data(), job.content.size());
+            if (job.stats)
+                job.stats->recordWrite(job.content.size(), elapsedNanoseconds(start));
+
+            if (ok && job.sync) {
+                start = std::chrono::steady_clock::now();
+                ok = fsync(fd) == 0;
+                if (job.stats)
+                    job.stats->recordSync(elapsedNanoseconds(start));
+            }
+            return close(fd) == 0 && ok;
+        }
+    };
+
+    // Rendered documents keyed by a hash of their content, for charts that are
+    //  regenerated from unchanged data.  Entries are kept in memory (least
+    //  recently used first out, up to memory_bytes) and, when a directory is
+    //  given, as <key>.svg files there that hits hard-link into place.  A
+    //  target served by a link shares its inode with the cache, so every
+    //  writer here opens its file through createFile, which unlinks such a
+    //  target instead of rewriting it in place; disk entries whose size or
+    //  mtime changed behind the cache's back are dropped.
+    class RenderCache
+    {
+    public:
+        explicit RenderCache(std::string const & directory = "", size_t memory_bytes = 64 << 20)
+            : directory(directory), memory_bytes(memory_bytes), memory_used(0), hit_count(0), miss_count(0) { }
+
+        // Writes the entry for key to target; false (a miss) if there is none.
+        bool serve(unsigned long long key, std::string const & target)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            std::unordered_map<unsigned long long, std::list<Entry>::iterator>::iterator found = memory.find(key);
+            if (found != memory.end()) {
+                lru.splice(lru.begin(), lru, found->second);
+                std::shared_ptr<std::string const> content = lru.front().content;
+                lock.unlock();
+                if (writeFile(target, *content)) {
+                    ++hit_count;
+                    return true;
+                }
+                ++miss_count;
+                return false;
+            }
+            lock.unlock();
+
+            if (!directory.empty() && linkFromDisk(key, target)) {
+                ++hit_count;
+                return true;
+            }
+            ++miss_count;
+            return false;
+        }
+        // Records target, just written with content, as the entry for key.
+        //  content is shared, not copied, and may be null when memory caching
+        //  is off.
+        void store(unsigned long long key, std::string const & target,
+            std::shared_ptr<std::string const> const & content)
+        {
+            if (content && content->size() <= memory_bytes) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!memory.count(key)) {
+                    lru.push_front(Entry(key, content));
+                    memory[key] = lru.begin();
+                    memory_used += content->size();
+                    while (memory_used > memory_bytes) {
+                        memory_used -= lru.back().content->size();
+                        memory.erase(lru.back().key);
+                        lru.pop_back();
+                    }
+                }
+            }
+            if (!directory.empty()) {
+                std::string path = entryPath(key);
+                unlink(path.c_str());
+                struct stat st;
+                if (link(target.c_str(), path.c_str()) == 0 && stat(path.c_str(), &st) == 0) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    on_disk[key] = Stamp(st);
+                }
+            }
+        }
+        bool cachesInMemory() const { return memory_bytes > 0; }
+        unsigned long long hits() const { return hit_count; }
+        unsigned long long misses() const { return miss_count; }
+
+    private:
+        struct Entry
+        {
+            Entry(unsigned long long key, std::shared_ptr<std::string const> const & content)
+                : key(key), content(content) { }
+            unsigned long long key;
+            // Shared so a hit can write it out after releasing the lock.
+            std::shared_ptr<std::string const> content;
+        };
+        struct Stamp
+        {
+            Stamp() : size(0), mtime(0), mtime_ns(0) { }
+            explicit Stamp(struct stat const & st)
+                : size(st.st_size), mtime(st.st_mtim.tv_sec), mtime_ns(st.st_mtim.tv_nsec) { }
+            bool operator==(Stamp const & other) const
+            {
+                return size == other.size && mtime == other.mtime && mtime_ns == other.mtime_ns;
+            }
+            long long size;
+            long long mtime;
+            long long mtime_ns;
+        };
+
+        std::string directory;
+        size_t memory_bytes;
+        size_t memory_used;
+        std::atomic<unsigned long long> hit_count;
+        std::atomic<unsigned long long> miss_count;
+        std::mutex mutex;
+        std::list<Entry> lru;
+        std::unordered_map<unsigned long long, std::list<Entry>::iterator> memory;
+        std::unordered_map<unsigned long long, Stamp> on_disk;
+
+        std::string entryPath(unsigned long long key) const
+        {
+            char name[24];
+            std::snprintf(name, sizeof(name), "%016llx", key);
+            return directory + "/" + name + ".svg";
+        }
+        // Entries left by an earlier process are trusted the first time they
+        //  are seen; afterwards their stamp must match.
+        bool linkFromDisk(unsigned long long key, std::string const & target)
+        {
+            std::string path = entryPath(key);
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0)
+                return false;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::unordered_map<unsigned long long, Stamp>::iterator known = on_disk.find(key);
+                if (known == on_disk.end())
+                    on_disk[key] = Stamp(st);
+                else if (!(known->second == Stamp(st))) {
+                    on_disk.erase(known);
+                    unlink(path.c_str());
+                    return false;
+                }
+            }
+            unlink(target.c_str());
+            return link(path.c_str(), target.c_str()) == 0;
+        }
+        static bool writeFile(std::string const & target, std::string const & content)
+        {
+            int fd = createFile(target);
+            if (fd < 0)
+                return false;
+            bool ok = writeAll(fd, content.data(), content.size());
+            return close(fd) == 0 && ok;
+        }
+    };
+
+    // Process-wide writer used by Document::saveAsync().
+    AsyncWriter & defaultAsyncWriter()
+    {
+        static AsyncWriter writer;
+        return writer;
+    }
+
+    class Document
+    {
+    public:
+        Document(std::string const & file_name, Layout layout = Layout())
+            : file_name(file_name), layout(layout), index_dirty(false), intern_styles(false),
+            stats(0), sync_on_save(false), minify_output(false), raster(0) { }
+
+        // Record per-shape and save timings into stats (null to stop recording).
+        void setStats(RenderStats * stats)
+        {
+            this->stats = stats;
+        }
+        // fsync the file at the end of save.
+        void syncOnSave(bool enable = true)
+        {
+            sync_on_save = enable;
+        }
+        // Also draw every shape added with << or append into raster (null to
+        //  stop), e.g. for a PNG thumbnail.  Streamed shapes are not drawn.
+        void setRaster(Raster * raster)
+        {
+            this->raster = raster;
+        }
+
+        // Shapes added after this call reference shared CSS classes instead of
+        //  repeating their fill/stroke/font attributes.
+        void internStyles(bool enable = true)
+        {
+            intern_styles = enable;
+        }
+        // Pass everything the document outputs through a Minifier.
+        void minifyOutput(bool enable = true)
+        {
+            minify_output = enable;
+        }
+
+        Document & operator<<(Shape const & shape)
+        {
+            std::chrono::steady_clock::time_point start;
+            if (stats)
+                start = std::chrono::steady_clock::now();
+
+            Layout context = serializationLayout();
+            Writer counter;
+            shape.serialize(counter, context);
+            appendNode(shape, counter.size(), context);
+            if (raster)
+                shape.rasterize(*raster);
+
+            if (stats)
+                stats->recordShape(typeid(shape), counter.size(), elapsedNanoseconds(start));
+            return *this;
+        }
+        // Images are kept and encoded from their file each time the document
+        //  is saved or rendered, in order with the shapes around them, so the
+        //  payload never sits in the body.
+        Document & operator<<(Image const & image)
+        {
+            Deferred deferred;
+            deferred.position = body_nodes_str.size();
+            deferred.node = nodes.size();
+            deferred.image = std::make_shared<Image>(image);
+            deferreds.push_back(deferred);
+            return *this;
+        }
+#if __cplusplus >= 201703L
+        // Two-pass append of every shape in shapes, dispatched statically on
+        //  each shape's type; images are kept and streamed as by <<.
+        Document & operator<<(ShapeList const & shapes)
+        {
+            Layout context = serializationLayout();
+            std::vector<size_t> sizes(shapes.size());
+            std::vector<unsigned long long> times(stats ? shapes.size() : 0);
+            size_t total = 0;
+            for (size_t i = 0; i < shapes.size(); ++i) {
+                if (std::holds_alternative<Image>(shapes[i]))
+                    continue;
+                std::chrono::steady_clock::time_point start;
+                if (stats)
+                    start = std::chrono::steady_clock::now();
+                Writer counter;
+                svg::serialize(shapes[i], counter, context);
+                sizes[i] = counter.size();
+                total += sizes[i];
+                if (stats)
+                    times[i] = elapsedNanoseconds(start);
+            }
+
+            body_nodes_str.reserve(body_nodes_str.size() + total);
+            nodes.reserve(nodes.size() + shapes.size());
+            for (size_t i = 0; i < shapes.size(); ++i) {
+                if (std::holds_alternative<Image>(shapes[i])) {
+                    *this << std::get<Image>(shapes[i]);
+                    continue;
+                }
+                std::chrono::steady_clock::time_point start;
+                if (stats)
+                    start = std::chrono::steady_clock::now();
+                appendNode(shapes[i], sizes[i], context);
+                if (raster)
+                    svg::rasterize(shapes[i], *raster);
+                if (stats)
+                    stats->recordShape(typeid(asShape(shapes[i])), sizes[i], times[i] + elapsedNanoseconds(start));
+            }
+            return *this;
+        }
+#endif
+        // Two-pass append of a range of shapes: the exact size of every shape is
+        //  counted first, the body grows once, and each shape is then written in
+        //  place.  Use it for large batches to avoid repeated reallocation.
+        template <typename Iterator>
+        Document & append(Iterator first, Iterator last)
+        {
+            Layout context = serializationLayout();
+            std::vector<size_t> sizes;
+            std::vector<unsigned long long> times;
+            size_t total = 0;
+            for (Iterator it = first; it != last; ++it) {
+                std::chrono::steady_clock::time_point start;
+                if (stats)
+                    start = std::chrono::steady_clock::now();
+                Writer counter;
+                static_cast<Shape const &>(*it).serialize(counter, context);
+                sizes.push_back(counter.size());
+                total += counter.size();
+                if (stats)
+                    times.push_back(elapsedNanoseconds(start));
+            }
+
+            body_nodes_str.reserve(body_nodes_str.size() + total);
+            nodes.reserve(nodes.size() + sizes.size());
+            size_t i = 0;
+            for (Iterator it = first; it != last; ++it, ++i) {
+                std::chrono::steady_clock::time_point start;
+                if (stats)
+                    start = std::chrono::steady_clock::now();
+                Shape const & shape = *it;
+                appendNode(shape, sizes[i], context);
+                if (raster)
+                    shape.rasterize(*raster);
+                if (stats)
+                    stats->recordShape(typeid(shape), sizes[i], times[i] + elapsedNanoseconds(start));
+            }
+            return *this;
+        }
+        // Adds the shapes of range, an input range or generator, without
+        //  storing them: they are pulled and serialized each time the document
+        //  is saved or rendered, in order with the shapes around them.  A
+        //  single-pass range yields its shapes to the first save only, and
+        //  must not be pulled by concurrent renders.  Pulled shapes carry
+        //  their own style attributes; gradients and patterns they introduce
+        //  go into a second <defs> block after the body.
+        template <typename Range>
+        Document & stream(Range range)
+        {
+            std::shared_ptr<Range> held = std::make_shared<Range>(std::move(range));
+            Deferred deferred;
+            deferred.position = body_nodes_str.size();
+            deferred.node = nodes.size();
+            deferred.pull = [held](ShapeSink const & sink) {
+                for (auto && shape : *held)
+                    sink(static_cast<Shape const &>(shape));
+            };
+            deferreds.push_back(deferred);
+            return *this;
+        }
+        // Reserve room for body_size bytes of shapes, when known in advance.
+        void reserve(size_t body_size)
+        {
+            body_nodes_str.reserve(body_size);
+        }
+        // Removes every shape, style and definition and turns the options
+        //  above (stats, sync, raster, interning, minifying) back off, so a
+        //  reused document starts like a new one.  The file name, layout and
+        //  allocated body are kept, so one document can serve many small
+        //  charts.
+        void clear()
+        {
+            body_nodes_str.clear();
+            nodes.clear();
+            index = SpatialGrid();
+            index_dirty = false;
+            style_sheet = StyleSheet();
+            definitions = Definitions();
+            deferreds.clear();
+            intern_styles = false;
+            stats = 0;
+            sync_on_save = false;
+            minify_output = false;
+            raster = 0;
+        }
+        std::string toString() const
+        {
+            std::string str;
+            renderTo(str);
+            return str;
+        }
+        // Appends the whole document to str, reusing its capacity.
+        void renderTo(std::string & str) const
+        {
+            Output out(&str);
+            emit(out, 0, layout.dimensions);
+        }
+        // Render only the shapes whose bounds intersect viewbox (native space).
+        //  The root element gets a matching viewBox so the visible region fills
+        //  the document dimensions.  Shapes keep their insertion (paint) order.
+        std::string render(Box const & viewbox) const
+        {
+            return render(viewbox, layout.dimensions);
+        }
+        // As above, with the root element sized to size instead, e.g. a map tile.
+        std::string render(Box const & viewbox, Dimensions const & dimensions) const
+        {
+            std::string str;
+            Output out(&str);
+            emit(out, &viewbox, dimensions);
+            return str;
+        }
+        // The index is rebuilt lazily by render; call this first when several
+        //  threads will render the same document concurrently.
+        void buildIndex() const
+        {
+            std::vector<Box> boxes(nodes.size());
+            for (unsigned i = 0; i < nodes.size(); ++i)
+                boxes[i] = nodes[i].bounds;
+            index.build(boxes);
+            index_dirty = false;
+        }
+        // Writes header, body and footer straight from their buffers; the
+        //  document is never assembled into one string, and streamed shapes
+        //  pass through a bounded buffer.
+        bool save() const
+        {
+            return write(0);
+        }
+        bool save(Box const & viewbox) const
+        {
+            return write(&viewbox);
+        }
+        // Serves the file from cache when the header, body and layout hash to
+        //  a rendered entry, skipping serialization and the write; otherwise
+        //  saves and records the result.  Documents with streamed shapes or
+        //  images cannot be hashed without reading them and are saved uncached.
+        bool save(RenderCache & cache) const
+        {
+            if (!deferreds.empty())
+                return save();
+
+            std::string header = headerString(0);
+            double const placement[] = { layout.dimensions.width, layout.dimensions.height, layout.scale,
+                static_cast<double>(layout.origin), layout.origin_offset.x, layout.origin_offset.y,
+                minify_output ? 1.0 : 0.0 };
+            unsigned long long key = hashBytes(placement, sizeof(placement));
+            key = hashBytes(header.data(), header.size(), key);
+            key = hashBytes(body_nodes_str.data(), body_nodes_str.size(), key);
+            if (cache.serve(key, file_name))
+                return true;
+
+            if (!cache.cachesInMemory()) {
+                if (!write(0))
+                    return false;
+                cache.store(key, file_name, std::shared_ptr<std::string const>());
+                return true;
+            }
+            // Render once; the same buffer is written and becomes the entry.
+            std::shared_ptr<std::string> content = std::make_shared<std::string>();
+            renderTo(*content);
+            if (!writeRendered(*content))
+                return false;
+            cache.store(key, file_name, content);
+            return true;
+        }
+        // Serializes on the calling thread into a buffer recycled by writer and
+        //  leaves the file write (and fsync) to writer's I/O thread.  Blocks
+        //  only while writer's queue is full.  The document may be changed or
+        //  destroyed as soon as this returns.
+        std::future<bool> saveAsync(AsyncWriter & writer) const
+        {
+            std::string content = writer.acquireBuffer();
+            Output out(&content);
+            emit(out, 0, layout.dimensions);
+            return writer.submit(file_name, std::move(content), sync_on_save, stats);
+        }
+        std::future<bool> saveAsync() const
+        {
+            return saveAsync(defaultAsyncWriter());
+        }
+        Layout const & getLayout() const { return layout; }
+    private:
+        struct Node
+        {
+            Box bounds;
+            size_t begin;
+            size_t length;
+        };
+        typedef std::function<void(Shape const &)> ShapeSink;
+        // A streamed range or an image, positioned in the body before nodes[node].
+        struct Deferred
+        {
+            size_t position;
+            size_t node;
+            std::function<void(ShapeSink const &)> pull;
+            std::shared_ptr<Image const> image;
+        };
+        // Where emit puts the document: a string, or a file written in chunks.
+        class Output
+        {
+        public:
+            static const size_t chunk_size = 64 * 1024;
+
+            explicit Output(std::string * str)
+                : str(str), fd(-1), ok(true), written(0), write_ns(0), minifier(0) { }
+            explicit Output(int fd)
+                : str(0), fd(fd), ok(true), written(0), write_ns(0), minifier(0) { }
+            // Route everything appended from now on through minifier.
+            void minifyWith(Minifier * minifier)
+            {
+                this->minifier = minifier;
+            }
+            // Flushes and detaches the minifier, returned for minifyWith once
+            //  output it must not hold back has been appended.
+            Minifier * suspendMinifier()
+            {
+                Minifier * held = minifier;
+                if (held)
+                    held->flush(str ? *str : buffer);
+                minifier = 0;
+                return held;
+            }
+            void reserve(size_t size)
+            {
+                if (str)
+                    str->reserve(size);
+                else
+                    buffer.reserve(chunk_size);
+            }
+            void append(char const * data, size_t size)
+            {
+                if (minifier) {
+                    std::string & target = str ? *str : buffer;
+                    minifier->feed(data, size, target);
+                    if (!str && buffer.size() >= chunk_size)
+                        flush();
+                    return;
+                }
+                if (str) {
+                    str->append(data, size);
+                    return;
+                }
+                if (buffer.size() + size > chunk_size) {
+                    flush();
+                    if (size >= chunk_size) {
+                        writeOut(data, size);
+                        return;
+                    }
+                }
+                buffer.append(data, size);
+            }
+            void append(std::string const & data)
+            {
+                append(data.data(), data.size());
+            }
+            // Room for size bytes at the end, to be filled by the caller and
+            //  then committed.
+            char * extend(size_t size)
+            {
+                if (minifier) {
+                    scratch.resize(size);
+                    return &scratch[0];
+                }
+                std::string & target = str ? *str : buffer;
+                if (!str && buffer.size() + size > chunk_size)
+                    flush();
+                size_t begin = target.size();
+                target.resize(begin + size);
+                return &target[begin];
+            }
+            void commit()
+            {
+                if (minifier)
+                    append(scratch.data(), scratch.size());
+            }
+            // Drops the whitespace at both ends of the last size bytes, appended
+            //  through extend while no minifier was attached.
+            void trim(size_t size)
+            {
+                std::string & target = str ? *str : buffer;
+                size_t const begin = target.size() - size;
+                size_t skip = 0;
+                while (skip < size && std::isspace(static_cast<unsigned char>(target[begin + skip])))
+                    ++skip;
+                target.erase(begin, skip);
+                while (target.size() > begin && std::isspace(static_cast<unsigned char>(target.back())))
+                    target.pop_back();
+            }
+            // Ends the document: releases what the minifier holds back.
+            void finish()
+            {
+                if (minifier) {
+                    minifier->finish(str ? *str : buffer);
+                    minifier = 0;
+                }
+            }
+            bool flush()
+            {
+                if (!buffer.empty()) {
+                    writeOut(buffer.data(), buffer.size());
+                    buffer.clear();
+                }
+                return ok;
+            }
+            size_t bytesWritten() const { return written; }
+            unsigned long long writeTime() const { return write_ns; }
+        private:
+            std::string * str;
+            int fd;
+            bool ok;
+            size_t written;
+            unsigned long long write_ns;
+            std::string buffer;
+            Minifier * minifier;
+            std::string scratch;
+
+            void writeOut(char const * data, size_t size)
+            {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                ok = ok && writeAll(fd, data, size);
+                written += size;
+                write_ns += elapsedNanoseconds(start);
+            }
+        };
+        // Passes streamed pieces on to out with the whitespace around each
+        //  trimmed; for images, whose payload has none.
+        class TrimmedOutput
+        {
+        public:
+            explicit TrimmedOutput(Output & out) : out(out), size(0) { }
+            char * extend(size_t size)
+            {
+                this->size = size;
+                return out.extend(size);
+            }
+            void commit()
+            {
+                out.commit();
+                out.trim(size);
+            }
+        private:
+            Output & out;
+            size_t size;
+        };
+
+        std::string file_name;
+        Layout layout;
+
+        std::string body_nodes_str;
+        std::vector<Node> nodes;
+        mutable SpatialGrid index;
+        mutable bool index_dirty;
+        bool intern_styles;
+        StyleSheet style_sheet;
+        Definitions definitions;
+        RenderStats * stats;
+        bool sync_on_save;
+        bool minify_output;
+        Raster * raster;
+        std::vector<Deferred> deferreds;
+
+        // Writes shape, whose serialized size is known, at the end of the body.
+        void appendNode(Shape const & shape, size_t size, Layout const & context)
+        {
+            Node node;
+            node.begin = body_nodes_str.size();
+            node.length = size;
+            body_nodes_str.resize(node.begin + size);
+            if (size) {
+                Writer writer(&body_nodes_str[node.begin]);
+                shape.serialize(writer, context);
+            }
+            node.bounds = shape.getBounds(layout);
+            nodes.push_back(node);
+            index_dirty = true;
+        }
+#if __cplusplus >= 201703L
+        void appendNode(ShapeValue const & shape, size_t size, Layout const & context)
+        {
+            Node node;
+            node.begin = body_nodes_str.size();
+            node.length = size;
+            body_nodes_str.resize(node.begin + size);
+            if (size) {
+                Writer writer(&body_nodes_str[node.begin]);
+                svg::serialize(shape, writer, context);
+            }
+            node.bounds = svg::getBounds(shape, layout);
+            nodes.push_back(node);
+            index_dirty = true;
+        }
+#endif
+        // The document's layout, pointing at this document's definitions and,
+        //  if enabled, its style sheet.
+        Layout serializationLayout()
+        {
+            Layout context = layout;
+            context.style_sheet = intern_styles ? &style_sheet : 0;
+            context.definitions = &definitions;
+            return context;
+        }
+
+        std::string headerString(Box const * viewbox) const
+        {
+            return headerString(viewbox, layout.dimensions);
+        }
+        std::string headerString(Box const * viewbox, Dimensions const & size) const
+        {
+            std::stringstream ss;
+            ss << "<?xml " << attribute("version", "1.0") << attribute("standalone", "no")
+                << "?>\n<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" "
+                << "\"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n<svg "
+                << attribute("width", size.width, "px")
+                << attribute("height", size.height, "px");
+            if (viewbox) {
+                std::stringstream box;
+                box << viewbox->min_x << " " << viewbox->min_y << " "
+                    << viewbox->width() << " " << viewbox->height();
+                ss << attribute("viewBox", box.str());
+            }
+            ss << attribute("xmlns", "http://www.w3.org/2000/svg")
+                << attribute("version", "1.1") << ">\n" << definitions.toString()
+                << style_sheet.toString();
+            return ss.str();
+        }
+        // Header, the body (only shapes intersecting viewbox, if given) with
+        //  streamed shapes pulled in place, late definitions and footer.
+        void emit(Output & out, Box const * viewbox, Dimensions const & dimensions) const
+        {
+            std::vector<unsigned> ids;
+            if (viewbox) {
+                if (index_dirty)
+                    buildIndex();
+                index.query(*viewbox, ids);
+            }
+
+            std::string header = headerString(viewbox, dimensions);
+            std::string const footer = elemEnd("svg");
+            size_t size = header.size() + footer.size();
+            size_t visible = 0;
+            if (viewbox) {
+                for (unsigned i = 0; i < ids.size(); ++i)
+                    if (nodes[ids[i]].bounds.intersects(*viewbox)) {
+                        ids[visible++] = ids[i];
+                        size += nodes[ids[i]].length;
+                    }
+            }
+            else
+                size += body_nodes_str.size();
+            out.reserve(size);
+            Minifier minifier;
+            if (minify_output)
+                out.minifyWith(&minifier);
+            out.append(header);
+
+            Definitions late(&definitions);
+            Layout context = layout;
+            context.definitions = &late;
+
+            size_t written = 0, next = 0;
+            for (unsigned d = 0; d <= deferreds.size(); ++d) {
+                bool last = d == deferreds.size();
+                if (!viewbox) {
+                    size_t position = last ? body_nodes_str.size() : deferreds[d].position;
+                    out.append(body_nodes_str.data() + written, position - written);
+                    written = position;
+                }
+                else
+                    for (size_t node = last ? nodes.size() : deferreds[d].node;
+                        next < visible && ids[next] < node; ++next)
+                        out.append(body_nodes_str.data() + nodes[ids[next]].begin, nodes[ids[next]].length);
+                if (!last && deferreds[d].image)
+                    writeImage(out, *deferreds[d].image, viewbox);
+                else if (!last)
+                    pullShapes(out, deferreds[d], viewbox, context);
+            }
+
+            out.append(late.toString());
+            out.append(footer);
+            out.finish();
+        }
+        void writeImage(Output & out, Image const & image, Box const * viewbox) const
+        {
+            std::chrono::steady_clock::time_point start;
+            if (stats)
+                start = std::chrono::steady_clock::now();
+            if (viewbox && !image.getBounds(layout).intersects(*viewbox))
+                return;
+
+            Writer counter;
+            image.serialize(counter, layout);
+            // The minifier would collect the whole tag, payload included,
+            //  before rewriting it; images bypass it and stay in 64KB pieces.
+            //  Without it, the indentation and line break it would have
+            //  dropped are trimmed from each piece.
+            Minifier * minifier = out.suspendMinifier();
+            if (minifier) {
+                TrimmedOutput trimmed(out);
+                image.streamTo(trimmed, layout);
+            }
+            else
+                image.streamTo(out, layout);
+            out.minifyWith(minifier);
+            if (stats)
+                stats->recordShape(typeid(image), counter.size(), elapsedNanoseconds(start));
+        }
+        void pullShapes(Output & out, Deferred const & deferred, Box const * viewbox,
+            Layout const & context) const
+        {
+            deferred.pull([&](Shape const & shape) {
+                std::chrono::steady_clock::time_point start;
+                if (stats)
+                    start = std::chrono::steady_clock::now();
+                if (viewbox && !shape.getBounds(layout).intersects(*viewbox))
+                    return;
+
+                Writer counter;
+                shape.serialize(counter, context);
+                if (counter.size()) {
+                    Writer writer(out.extend(counter.size()));
+                    shape.serialize(writer, context);
+                    out.commit();
+                }
+                if (stats)
+                    stats->recordShape(typeid(shape), counter.size(), elapsedNanoseconds(start));
+            });
+        }
+        bool write(Box const * viewbox) const
+        {
+            int fd = createFile(file_name);
+            if (fd < 0)
+                return false;
+
+            Output out(fd);
+            emit(out, viewbox, layout.dimensions);
+            bool ok = out.flush();
+            if (stats)
+                stats->recordWrite(out.bytesWritten(), out.writeTime());
+            return finishWrite(fd, ok);
+        }
+        // As write, for a document already rendered into content.
+        bool writeRendered(std::string const & content) const
+        {
+            int fd = createFile(file_name);
+            if (fd < 0)
+                return false;
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            bool ok = writeAll(fd, content.data(), content.size());
+            if (stats)
+                stats->recordWrite(content.size(), elapsedNanoseconds(start));
+            return finishWrite(fd, ok);
+        }
+        bool finishWrite(int fd, bool ok) const
+        {
+            if (ok && sync_on_save) {
+                std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                ok = fsync(fd) == 0;
+                if (stats)
+                    stats->recordSync(elapsedNanoseconds(start));
+            }
+            return close(fd) == 0 && ok;
+        }
+    };
+
+    // Renders a Document as a z/x/y pyramid of square SVG tiles for viewers that
+    //  load only the visible region.  Zoom level z splits a square as wide as
+    //  the document's longer side into 2^z x 2^z tiles written to
+    //  directory/z/x/y.svg; tiles past the shorter side come out partly or
+    //  wholly blank, as with map tiles.  Every tile is culled through the
+    //  document's spatial index and carries the same defs and style block;
+    //  tiles are rendered in parallel.
+    class TileRenderer
+    {
+    public:
+        TileRenderer(Document const & document, std::string const & directory,
+            double tile_size = 256)
+            : document(document), directory(directory), tile_size(tile_size), tiles_written(0) { }
+
+        // Renders zoom levels 0 to max_zoom on threads workers (0: one per core).
+        bool render(unsigned max_zoom, unsigned threads = 0)
+        {
+            if (threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency());
+
+            // Directories first, sequentially; workers only create files.
+            std::vector<Tile> tiles;
+            if (!makeDirectory(directory))
+                return false;
+            for (unsigned z = 0; z <= max_zoom; ++z) {
+                if (!makeDirectory(zoomPath(z)))
+                    return false;
+                unsigned count = 1u << z;
+                for (unsigned x = 0; x < count; ++x) {
+                    if (!makeDirectory(columnPath(z, x)))
+                        return false;
+                    for (unsigned y = 0; y < count; ++y)
+                        tiles.push_back(Tile(z, x, y));
+                }
+            }
+
+            // The index must exist before concurrent render calls.
+            document.buildIndex();
+            std::atomic<size_t> next(0);
+            std::atomic<size_t> written(0);
+            std::atomic<bool> failed(false);
+            std::vector<std::thread> workers;
+            for (unsigned i = 0; i < threads; ++i)
+                workers.push_back(std::thread([&]() {
+                    for (size_t t = next++; t < tiles.size(); t = next++) {
+                        if (renderTile(tiles[t]))
+                            ++written;
+                        else
+                            failed = true;
+                    }
+                }));
+            for (unsigned i = 0; i < workers.size(); ++i)
+                workers[i].join();
+
+            tiles_written = written;
+            return !failed;
+        }
+        size_t tilesWritten() const { return tiles_written; }
+    private:
+        struct Tile
+        {
+            Tile(unsigned z, unsigned x, unsigned y) : z(z), x(x), y(y) { }
+            unsigned z;
+            unsigned x;
+            unsigned y;
+        };
+
+        Document const & document;
+        std::string directory;
+        double tile_size;
+        size_t tiles_written;
+
+        bool renderTile(Tile const & tile) const
+        {
+            Dimensions const & dimensions = document.getLayout().dimensions;
+            double side = std::max(dimensions.width, dimensions.height) / (1u << tile.z);
+            Box viewbox(tile.x * side, tile.y * side, (tile.x + 1) * side, (tile.y + 1) * side);
+
+            std::string content = document.render(viewbox, Dimensions(tile_size, tile_size));
+            std::stringstream path;
+            path << columnPath(tile.z, tile.x) << "/" << tile.y << ".svg";
+            int fd = createFile(path.str());
+            if (fd < 0)
+                return false;
+            bool ok = writeAll(fd, content.data(), content.size());
+            return close(fd) == 0 && ok;
+        }
+        std::string zoomPath(unsigned z) const
+        {
+            std::stringstream ss;
+            ss << directory << "/" << z;
+            return ss.str();
+        }
+        std::string columnPath(unsigned z, unsigned x) const
+        {
+            std::stringstream ss;
+            ss << zoomPath(z) << "/" << x;
+            return ss.str();
+        }
+        static bool makeDirectory(std::string const & path)
+        {
+            return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+        }
+    };
+
+    // Renders many small documents on a pool of workers.  Each worker reuses
+    //  one Document and one output buffer for all its charts, and files are
+    //  created with openat relative to a directory descriptor opened once, so
+    //  a batch costs little more than building the shapes and copying bytes.
+    class BatchRenderer
+    {
+    public:
+        typedef std::function<void(Document &)> Builder;
+        struct Stats
+        {
+            Stats() : documents(0), failed(0), bytes(0), seconds(0) { }
+            double documentsPerSecond() const { return seconds > 0 ? documents / seconds : 0; }
+            double bytesPerSecond() const { return seconds > 0 ? bytes / seconds : 0; }
+            size_t documents;
+            size_t failed;
+            unsigned long long bytes;
+            double seconds;
+        };
+
+        BatchRenderer(std::string const & directory, Layout const & layout = Layout(), unsigned threads = 0)
+            : layout(layout), threads(threads ? threads : std::max(1u, std::thread::hardware_concurrency())),
+            directory_fd(open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)) { }
+        ~BatchRenderer()
+        {
+            if (directory_fd >= 0)
+                close(directory_fd);
+        }
+        // Owns directory_fd.
+        BatchRenderer(BatchRenderer const &) = delete;
+        BatchRenderer & operator=(BatchRenderer const &) = delete;
+        bool good() const { return directory_fd >= 0; }
+
+        // Queues file_name (relative to the directory), drawn by builder into
+        //  an empty document with this renderer's layout.  builder runs on a
+        //  worker thread.
+        void add(std::string const & file_name, Builder builder)
+        {
+            jobs.push_back(Job(file_name, builder));
+        }
+        // Renders and writes every queued document, then empties the queue.
+        bool run()
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            std::atomic<size_t> next(0);
+            std::atomic<size_t> failed(0);
+            std::atomic<unsigned long long> bytes(0);
+            std::vector<std::thread> workers;
+            for (unsigned i = 0; i < std::min<size_t>(threads, jobs.size()); ++i)
+                workers.push_back(std::thread([&]() {
+                    Document document("", layout);
+                    std::string buffer;
+                    for (size_t j = next++; j < jobs.size(); j = next++) {
+                        document.clear();
+                        jobs[j].builder(document);
+                        buffer.clear();
+                        document.renderTo(buffer);
+                        if (writeFile(jobs[j].file_name, buffer))
+                            bytes += buffer.size();
+                        else
+                            ++failed;
+                    }
+                }));
+            for (unsigned i = 0; i < workers.size(); ++i)
+                workers[i].join();
+
+            last_batch = Stats();
+            last_batch.documents = jobs.size();
+            last_batch.failed = failed;
+            last_batch.bytes = bytes;
+            last_batch.seconds = elapsedNanoseconds(start) / 1e9;
+            jobs.clear();
+            return last_batch.failed == 0;
+        }
+        Stats const & lastBatch() const { return last_batch; }
+    private:
+        struct Job
+        {
+            Job(std::string const & file_name, Builder const & builder)
+                : file_name(file_name), builder(builder) { }
+            std::string file_name;
+            Builder builder;
+        };
+
+        Layout layout;
+        unsigned threads;
+        int directory_fd;
+        std::vector<Job> jobs;
+        Stats last_batch;
+
+        bool writeFile(std::string const & file_name, std::string const & content) const
+        {
+            int fd = createFile(file_name, directory_fd);
+            if (fd < 0)
+                return false;
+            bool ok = writeAll(fd, content.data(), content.size());
+            return close(fd) == 0 && ok;
+        }
+    };
+
+#if __cplusplus >= 201703L
+    // Numeric CSV held column by column.  The file is mapped, split into
+    //  newline-aligned chunks and parsed on several threads: a first pass
+    //  counts each chunk's rows so the second can parse straight into the
+    //  final column arrays.  Fields that are not numbers load as NaN.
+    class CsvTable
+    {
+    public:
+        CsvTable(char delimiter = ',', bool has_header = true)
+            : delimiter(delimiter), has_header(has_header), row_count(0) { }
+
+        // Loads the columns named in selected (all when empty) on threads
+        //  workers (0: one per core).  Without a header row columns are named
+        //  "0", "1", ...  Fails if the file cannot be mapped or a selected
+        //  column does not exist or is selected twice.
+        bool load(std::string const & file_name, std::vector<std::string> const & selected = {},
+            unsigned threads = 0)
+        {
+            column_names.clear();
+            column_values.clear();
+            row_count = 0;
+
+            int fd = open(file_name.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat st;
+            if (fstat(fd, &st) != 0) {
+                close(fd);
+                return false;
+            }
+            size_t length = st.st_size;
+            if (length == 0) {
+                // No header to find a selected column in.
+                close(fd);
+                return selected.empty();
+            }
+            void * address = mmap(0, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (address == MAP_FAILED)
+                return false;
+            madvise(address, length, MADV_SEQUENTIAL);
+
+            bool ok = parse(static_cast<char const *>(address), length, selected, threads);
+            munmap(address, length);
+            if (!ok)
+                column_names.clear();
+            return ok;
+        }
+        size_t rows() const { return row_count; }
+        size_t columns() const { return column_values.size(); }
+        std::vector<std::string> const & names() const { return column_names; }
+        // Index of the named loaded column, or -1.
+        int columnIndex(std::string const & name) const
+        {
+            for (unsigned i = 0; i < column_names.size(); ++i)
+                if (column_names[i] == name)
+                    return i;
+            return -1;
+        }
+        std::vector<double> const & column(size_t index) const { return column_values[index]; }
+        // Series of column y against column x, ready for LineChart.
+        template <typename T = double>
+        BasicPolyline<T> polyline(size_t x, size_t y, Stroke const & stroke = Stroke()) const
+        {
+            BasicPolyline<T> polyline(stroke);
+            polyline.points.reserve(row_count);
+            for (size_t i = 0; i < row_count; ++i)
+                polyline << BasicPoint<T>(static_cast<T>(column_values[x][i]), static_cast<T>(column_values[y][i]));
+            return polyline;
+        }
+    private:
+        struct Chunk
+        {
+            Chunk(char const * begin, char const * end) : begin(begin), end(end), first_row(0) { }
+            char const * begin;
+            char const * end;
+            size_t first_row;
+        };
+
+        char delimiter;
+        bool has_header;
+        size_t row_count;
+        std::vector<std::string> column_names;
+        std::vector<std::vector<double> > column_values;
+
+        bool parse(char const * data, size_t length, std::vector<std::string> const & selected,
+            unsigned threads)
+        {
+            char const * end = data + length;
+            char const * body = data;
+            std::vector<std::string> fields = splitLine(data, lineEnd(data, end));
+            if (has_header)
+                body = std::min(end, lineEnd(data, end) + 1);
+            else
+                for (unsigned i = 0; i < fields.size(); ++i)
+                    fields[i] = std::to_string(i);
+
+            // target[f]: loaded column that field f goes to, or -1.
+            std::vector<int> target(fields.size(), -1);
+            if (selected.empty()) {
+                for (unsigned i = 0; i < fields.size(); ++i)
+                    target[i] = i;
+                column_names = fields;
+            }
+            for (unsigned i = 0; i < selected.size(); ++i) {
+                std::vector<std::string>::const_iterator found =
+                    std::find(fields.begin(), fields.end(), selected[i]);
+                if (found == fields.end() || target[found - fields.begin()] >= 0)
+                    return false;
+                target[found - fields.begin()] = i;
+                column_names.push_back(selected[i]);
+            }
+
+            if (threads == 0)
+                threads = std::max(1u, std::thread::hardware_concurrency());
+            std::vector<Chunk> chunks = split(body, end, threads * 4);
+
+            forEachChunk(chunks, threads, [&](Chunk & chunk) { chunk.first_row = countRows(chunk); });
+            for (unsigned i = 0; i < chunks.size(); ++i) {
+                size_t chunk_rows = chunks[i].first_row;
+                chunks[i].first_row = row_count;
+                row_count += chunk_rows;
+            }
+
+            column_values.assign(column_names.size(),
+                std::vector<double>(row_count, std::numeric_limits<double>::quiet_NaN()));
+            forEachChunk(chunks, threads, [&](Chunk & chunk) { parseChunk(chunk, target); });
+            return true;
+        }
+        // Byte ranges of about equal size, each ending just after a newline.
+        static std::vector<Chunk> split(char const * begin, char const * end, unsigned count)
+        {
+            std::vector<Chunk> chunks;
+            size_t step = std::max<size_t>(1, (end - begin) / count);
+            while (begin < end) {
+                char const * stop = begin + std::min<size_t>(step, end - begin);
+                stop = std::min(end, lineEnd(stop - 1, end) + 1);
+                chunks.push_back(Chunk(begin, stop));
+                begin = stop;
+            }
+            return chunks;
+        }
+        template <typename Function>
+        static void forEachChunk(std::vector<Chunk> & chunks, unsigned threads, Function function)
+        {
+            std::atomic<size_t> next(0);
+            std::vector<std::thread> workers;
+            for (unsigned i = 0; i < std::min<size_t>(threads, chunks.size()); ++i)
+                workers.push_back(std::thread([&]() {
+                    for (size_t c = next++; c < chunks.size(); c = next++)
+                        function(chunks[c]);
+                }));
+            for (unsigned i = 0; i < workers.size(); ++i)
+                workers[i].join();
+        }
+        static char const * lineEnd(char const * begin, char const * end)
+        {
+            char const * newline = static_cast<char const *>(std::memchr(begin, '\n', end - begin));
+            return newline ? newline : end;
+        }
+        static bool blank(char const * begin, char const * end)
+        {
+            return begin == end || (end - begin == 1 && *begin == '\r');
+        }
+        static size_t countRows(Chunk const & chunk)
+        {
+            size_t rows = 0;
+            for (char const * line = chunk.begin; line < chunk.end; ) {
+                char const * stop = lineEnd(line, chunk.end);
+                if (!blank(line, stop))
+                    ++rows;
+                line = stop + 1;
+            }
+            return rows;
+        }
+        void parseChunk(Chunk const & chunk, std::vector<int> const & target)
+        {
+            size_t row = chunk.first_row;
+            for (char const * line = chunk.begin; line < chunk.end; ) {
+                char const * stop = lineEnd(line, chunk.end);
+                if (!blank(line, stop)) {
+                    char const * field = line;
+                    for (unsigned f = 0; f < target.size() && field <= stop; ++f) {
+                        char const * field_end = static_cast<char const *>(
+                            std::memchr(field, delimiter, stop - field));
+                        if (!field_end)
+                            field_end = stop;
+                        if (target[f] >= 0)
+                            column_values[target[f]][row] = number(field, field_end);
+                        field = field_end + 1;
+                    }
+                    ++row;
+                }
+                line = stop + 1;
+            }
+        }
+        static double number(char const * begin, char const * end)
+        {
+            while (begin < end && (*begin == ' ' || *begin == '\t' || *begin == '"' || *begin == '+'))
+                ++begin;
+            double value;
+            std::from_chars_result result = std::from_chars(begin, end, value);
+            if (result.ec != std::errc())
+                return std::numeric_limits<double>::quiet_NaN();
+            for (char const * rest = result.ptr; rest < end; ++rest)
+                if (*rest != ' ' && *rest != '\t' && *rest != '"' && *rest != '\r')
+                    return std::numeric_limits<double>::quiet_NaN();
+            return value;
+        }
+        std::vector<std::string> splitLine(char const * begin, char const * end) const
+        {
+            if (end > begin && end[-1] == '\r')
+                --end;
+            std::vector<std::string> fields;
+            while (true) {
+                char const * stop = std::find(begin, end, delimiter);
+                std::string field(begin, stop);
+                size_t first = field.find_first_not_of(" \t\"");
+                size_t last = field.find_last_not_of(" \t\"");
+                fields.push_back(first == std::string::npos ? "" : field.substr(first, last - first + 1));
+                if (stop == end)
+                    return fields;
+                begin = stop + 1;
+            }
+        }
+    };
+#endif
 }
 
 #endif
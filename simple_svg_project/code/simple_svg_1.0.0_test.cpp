@@ -0,0 +1,403 @@
+// Checks for simple_svg_1.0.0.hpp; run with make test.  Every file is
+//  written under a fresh temporary directory.
+
+#include "simple_svg_1.0.0.hpp"
+
+#include <random>
+#include <zlib.h>
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+
+using namespace svg;
+
+namespace
+{
+    int failures = 0;
+
+    #define CHECK(cond) do { if (!(cond)) { std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", \
+        __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+    std::string directory;
+
+    std::string readFile(std::string const & path)
+    {
+        std::ifstream ifs(path.c_str(), std::ios::binary);
+        std::stringstream ss;
+        ss << ifs.rdbuf();
+        return ss.str();
+    }
+    void writeFile(std::string const & path, std::string const & content)
+    {
+        std::ofstream ofs(path.c_str(), std::ios::binary);
+        ofs << content;
+    }
+    bool wellFormed(std::string const & xml)
+    {
+        xmlDocPtr doc = xmlReadMemory(xml.data(), static_cast<int>(xml.size()), "test.svg", 0,
+            XML_PARSE_NONET | XML_PARSE_NOERROR | XML_PARSE_NOWARNING);
+        xmlFreeDoc(doc);
+        return doc != 0;
+    }
+    size_t occurrences(std::string const & text, std::string const & pattern)
+    {
+        size_t count = 0;
+        for (size_t at = text.find(pattern); at != std::string::npos; at = text.find(pattern, at + 1))
+            ++count;
+        return count;
+    }
+    std::string minifyInPieces(std::string const & svg, size_t piece)
+    {
+        std::string out;
+        Minifier minifier;
+        for (size_t at = 0; at < svg.size(); at += piece)
+            minifier.feed(svg.data() + at, std::min(piece, svg.size() - at), out);
+        minifier.finish(out);
+        return out;
+    }
+    // A document exercising every rewriting rule.
+    std::string sampleDocument()
+    {
+        Document document("", Layout(Dimensions(200, 200), Layout::BottomLeft));
+        for (int i = 0; i < 5; ++i)
+            document << Line(Point(i, 0), Point(i, 10.5), Stroke(0.5, Color::Black));
+        document << Line(Point(0, 0), Point(-3, -0.25), Stroke(2, Color::Red));
+        document << Rectangle(Point(0, 200), 20, 10, Fill(Color::Transparent), Stroke(1, Color::Blue));
+        document << Circle(Point(50, 50), 10, Fill(Color(255, 0, 0)));
+        document << Text(Point(5, 5), "a  b", Fill(Color::Black), Font(10, "Verdana"));
+        Polygon polygon(Fill(Color::Silver), Stroke(0.25, Color::Purple));
+        polygon << Point(0, 0) << Point(10.5, 0) << Point(10.5, 10.5);
+        document << polygon;
+        return document.toString();
+    }
+
+    void testMinifierOutputIsWellFormed()
+    {
+        std::string const svg = sampleDocument();
+        std::string const minified = minify(svg);
+        CHECK(wellFormed(svg));
+        CHECK(wellFormed(minified));
+        CHECK(minified.size() < svg.size());
+        // Five identical-style lines become one path; the sixth differs.
+        CHECK(occurrences(minified, "<path d=\"") == 1);
+        CHECK(occurrences(minified, "<line") == 1);
+        CHECK(minified.find("#f00") != std::string::npos);
+        CHECK(minified.find(">a  b<") != std::string::npos);
+
+        std::string const quoted = "<svg xmlns=\"http://www.w3.org/2000/svg\"><text x='a\"b' y=' 1 '>t</text></svg>";
+        CHECK(wellFormed(minify(quoted)));
+        CHECK(minify(quoted).find("x='a\"b'") != std::string::npos);
+    }
+    void testMinifierPiecesMatchWholeInput()
+    {
+        std::string const svg = sampleDocument()
+            + "<!-- a > b --><![CDATA[ <x> ]]><g fill='rgb(0,0,0)'>\n  <line x1=\"0\" y1=\"0\" x2=\"1\" y2=\"1\"/>\n</g>";
+        std::string const whole = minify(svg);
+        CHECK(minifyInPieces(svg, 1) == whole);
+        CHECK(minifyInPieces(svg, 7) == whole);
+        CHECK(minifyInPieces(svg, 4096) == whole);
+    }
+    void testMinifierKeepsMeaningfulDefaults()
+    {
+        std::string const gradient = minify("<linearGradient x1=\"0\" x2=\"0\" y2=\"1\"/>");
+        CHECK(gradient.find("x2=\"0\"") != std::string::npos);
+        CHECK(minify("<radialGradient cx=\"0\" cy=\"0\"/>").find("cx=\"0\"") != std::string::npos);
+        CHECK(minify("<rect x=\"0\" y=\"0\" width=\"2\"/>") == "<rect width=\"2\"/>");
+        CHECK(minify("<rect width=\"2\" fill=\"transparent\"/>").find("transparent") != std::string::npos);
+    }
+    // Images bypass the minifier; the whitespace it would have dropped
+    //  around them must still go.
+    void testMinifiedImage()
+    {
+        std::vector<unsigned char> data(200000);
+        std::mt19937 random(3);
+        for (size_t i = 0; i < data.size(); ++i)
+            data[i] = static_cast<unsigned char>(random());
+        std::string const image = directory + "/image.png";
+        writeFile(image, std::string(data.begin(), data.end()));
+        std::string payload((data.size() + 2) / 3 * 4, '\0');
+        encodeBase64(data.data(), data.size(), &payload[0]);
+
+        Document document(directory + "/image.svg", Layout(Dimensions(100, 100)));
+        document.minifyOutput();
+        document << Rectangle(Point(0, 100), 10, 10, Fill(Color::Blue));
+        document << Image(Point(0, 0), 50, 50, image);
+        document << Circle(Point(50, 50), 10, Fill(Color::Red));
+        document << Image(Point(50, 50), 50, 50, image);
+        CHECK(document.save());
+        std::string const saved = readFile(directory + "/image.svg");
+        CHECK(saved == document.toString());
+        CHECK(wellFormed(saved));
+        CHECK(saved.find_first_of("\t\n") == std::string::npos);
+        CHECK(occurrences(saved, "/><image ") == 2);
+        CHECK(occurrences(saved, ";base64," + payload + "\" />") == 2);
+        CHECK(saved.find("\" /><circle") != std::string::npos);
+        CHECK(saved.compare(saved.size() - 10, 10, "\" /></svg>") == 0);
+    }
+
+    void testBase64()
+    {
+        char const * const expected[] = { "", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy" };
+        unsigned char const foobar[] = "foobar";
+        for (size_t size = 0; size <= 6; ++size) {
+            std::string out((size + 2) / 3 * 4, '\0');
+            encodeBase64(foobar, size, &out[0]);
+            CHECK(out == expected[size]);
+        }
+
+        // Long input against the textbook encoding.
+        static char const alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::mt19937 random(7);
+        std::vector<unsigned char> data(100003);
+        for (size_t i = 0; i < data.size(); ++i)
+            data[i] = static_cast<unsigned char>(random());
+        std::string reference;
+        for (size_t i = 0; i < data.size(); i += 3) {
+            unsigned bits = data[i] << 16 | (i + 1 < data.size() ? data[i + 1] << 8 : 0)
+                | (i + 2 < data.size() ? data[i + 2] : 0);
+            reference += alphabet[bits >> 18];
+            reference += alphabet[(bits >> 12) & 63];
+            reference += i + 1 < data.size() ? alphabet[(bits >> 6) & 63] : '=';
+            reference += i + 2 < data.size() ? alphabet[bits & 63] : '=';
+        }
+        std::string out((data.size() + 2) / 3 * 4, '\0');
+        encodeBase64(data.data(), data.size(), &out[0]);
+        CHECK(out == reference);
+    }
+
+    unsigned readBig(std::string const & data, size_t at)
+    {
+        return unsigned(static_cast<unsigned char>(data[at])) << 24 | static_cast<unsigned char>(data[at + 1]) << 16
+            | static_cast<unsigned char>(data[at + 2]) << 8 | static_cast<unsigned char>(data[at + 3]);
+    }
+    // Pixels of a PNG written by encodePng, checking chunk CRCs on the way;
+    //  empty if anything does not decode.
+    std::vector<unsigned char> decodePng(std::string const & png, unsigned & width, unsigned & height)
+    {
+        std::vector<unsigned char> none;
+        if (png.compare(0, 8, "\x89PNG\r\n\x1a\n") != 0)
+            return none;
+        std::string idat;
+        for (size_t at = 8; at + 12 <= png.size(); ) {
+            unsigned length = readBig(png, at);
+            std::string type = png.substr(at + 4, 4);
+            unsigned char const * body = reinterpret_cast<unsigned char const *>(png.data() + at + 4);
+            if (::crc32(0, body, length + 4) != readBig(png, at + 8 + length))
+                return none;
+            if (type == "IHDR") {
+                width = readBig(png, at + 8);
+                height = readBig(png, at + 12);
+            }
+            else if (type == "IDAT")
+                idat += png.substr(at + 8, length);
+            at += 12 + length;
+        }
+
+        size_t const row_size = size_t(width) * 4;
+        std::vector<unsigned char> filtered((row_size + 1) * height);
+        uLongf size = filtered.size();
+        if (uncompress(filtered.data(), &size, reinterpret_cast<Bytef const *>(idat.data()), idat.size()) != Z_OK
+            || size != filtered.size())
+            return none;
+        std::vector<unsigned char> pixels(row_size * height);
+        for (unsigned y = 0; y < height; ++y) {
+            unsigned char const filter = filtered[y * (row_size + 1)];
+            unsigned char const * in = &filtered[y * (row_size + 1) + 1];
+            unsigned char * row = &pixels[y * row_size];
+            for (size_t x = 0; x < row_size; ++x) {
+                unsigned char left = x >= 4 ? row[x - 4] : 0;
+                unsigned char above = y ? row[x - row_size] : 0;
+                if (filter > 2)
+                    return none;
+                row[x] = static_cast<unsigned char>(in[x] + (filter == 1 ? left : filter == 2 ? above : 0));
+            }
+        }
+        return pixels;
+    }
+    void testPngRoundTrip()
+    {
+        std::mt19937 random(11);
+        unsigned const width = 13, height = 7;
+        std::vector<unsigned char> rgba(width * height * 4);
+        // Smooth rows favour Sub, repeated rows Up, noise None.
+        for (unsigned y = 0; y < height; ++y)
+            for (unsigned x = 0; x < width * 4; ++x)
+                rgba[y * width * 4 + x] = static_cast<unsigned char>(y < 2 ? x * 3 : y < 4 ? 200 : random());
+        unsigned decoded_width = 0, decoded_height = 0;
+        CHECK(decodePng(encodePng(width, height, rgba.data()), decoded_width, decoded_height) == rgba);
+        CHECK(decoded_width == width && decoded_height == height);
+
+        Raster raster(Layout(Dimensions(40, 30)));
+        raster << Circle(Point(20, 15), 16, Fill(Color::Red));
+        std::vector<unsigned char> pixels = decodePng(raster.toPng(), decoded_width, decoded_height);
+        CHECK(decoded_width == 40 && decoded_height == 30 && pixels.size() == 40 * 30 * 4);
+        bool same = !pixels.empty();
+        for (unsigned y = 0; same && y < 30; ++y)
+            for (unsigned x = 0; x < 40; ++x) {
+                unsigned char const * p = &pixels[(y * 40 + x) * 4];
+                same = same && raster.pixel(x, y) == (unsigned(p[0]) << 24 | p[1] << 16 | p[2] << 8 | p[3]);
+            }
+        CHECK(same);
+        CHECK(raster.pixel(20, 15) == 0xFF0000FF);
+        CHECK(raster.pixel(0, 0) == 0xFFFFFFFF);
+    }
+
+    void testCsv()
+    {
+        std::string const file = directory + "/table.csv";
+        writeFile(file, "x,y,label\n1,12abc,\"3\" \r\n 4 ,5e1,x\r\n\n7,-8,\n");
+        CsvTable table;
+        CHECK(table.load(file, std::vector<std::string>(), 2));
+        CHECK(table.rows() == 3 && table.columns() == 3);
+        CHECK(table.column(0)[0] == 1 && table.column(0)[1] == 4 && table.column(0)[2] == 7);
+        CHECK(std::isnan(table.column(1)[0]));
+        CHECK(table.column(1)[1] == 50 && table.column(1)[2] == -8);
+        CHECK(table.column(2)[0] == 3 && std::isnan(table.column(2)[1]) && std::isnan(table.column(2)[2]));
+
+        CHECK(table.load(file, { "y", "x" }));
+        CHECK(table.columns() == 2 && table.columnIndex("x") == 1 && table.column(1)[2] == 7);
+        CHECK(!table.load(file, { "x", "x" }));
+        CHECK(!table.load(file, { "z" }));
+        CHECK(table.columns() == 0);
+
+        CsvTable headerless(',', false);
+        CHECK(headerless.load(file, { "1" }));
+        CHECK(headerless.rows() == 4 && std::isnan(headerless.column(0)[0]));
+
+        std::string const empty = directory + "/empty.csv";
+        writeFile(empty, "");
+        CHECK(table.load(empty) && table.rows() == 0);
+        CHECK(!table.load(empty, { "x" }));
+        CHECK(!table.load(directory + "/missing.csv"));
+    }
+
+    void testCacheInMemory()
+    {
+        RenderCache cache("", 1 << 20);
+        Layout layout(Dimensions(100, 100));
+        Document first(directory + "/m1.svg", layout);
+        first << Circle(Point(50, 50), 20, Fill(Color::Red));
+        CHECK(first.save(cache));
+        Document second(directory + "/m2.svg", layout);
+        second << Circle(Point(50, 50), 20, Fill(Color::Red));
+        CHECK(second.save(cache));
+        CHECK(cache.hits() == 1 && cache.misses() == 1);
+        CHECK(readFile(directory + "/m2.svg") == first.toString());
+
+        // The layout is part of the key.
+        Document moved(directory + "/m3.svg", Layout(Dimensions(100, 100), Layout::TopLeft));
+        moved << Circle(Point(50, 50), 20, Fill(Color::Red));
+        CHECK(moved.save(cache));
+        CHECK(cache.misses() == 2);
+        CHECK(readFile(directory + "/m3.svg") == moved.toString());
+    }
+
+    void testAnimation()
+    {
+        Layout const layout(Dimensions(100, 100));
+        Animation animation(0.5);
+        for (int frame = 0; frame < 8; ++frame) {
+            if (frame)
+                animation.nextFrame();
+            animation << Rectangle(Point(10, 90), 10, 10 + frame / 4 * 10, Fill(Color::Blue));
+            animation << Circle(Point(50, 50), 10, Fill(Color::Green));
+            Polyline line(Stroke(1, Color::Red));
+            line << Point(0, 0) << Point(50, frame);
+            if (frame < 6)
+                animation << line;
+        }
+        CHECK(animation.frameCount() == 8);
+
+        Document document("", layout);
+        document << animation;
+        std::string const svg = document.toString();
+        CHECK(wellFormed(svg));
+        // Only the rectangle's height and the line's points change.
+        CHECK(occurrences(svg, "<animate ") == 2);
+        CHECK(svg.find("attributeName=\"height\" values=\"10;20\" keyTimes=\"0;0.5\" dur=\"4s\" "
+            "calcMode=\"discrete\" repeatCount=\"indefinite\"") != std::string::npos);
+        CHECK(occurrences(svg, "attributeName=\"points\"") == 1);
+        CHECK(svg.find("<circle cx=\"50\" cy=\"50\" r=\"5\" fill=\"rgb(0,128,0)\" />") != std::string::npos);
+
+        Animation linear(1, true, false);
+        linear << Circle(Point(0, 0), 2, Fill(Color::Black));
+        linear.nextFrame() << Circle(Point(0, 0), 2, Fill(Color::Black));
+        linear.nextFrame() << Circle(Point(10, 0), 2, Fill(Color::Black));
+        std::string const moving = linear.toString(layout);
+        CHECK(moving.find("values=\"0;0;10\" keyTimes=\"0;0.5;1\" dur=\"2s\" calcMode=\"linear\" fill=\"freeze\"")
+            != std::string::npos);
+
+        // offset moves every frame.
+        Box before = animation.getBounds(layout);
+        animation.offset(Point(5, 0));
+        Box after = animation.getBounds(layout);
+        CHECK(after.min_x == before.min_x + 5 && after.max_x == before.max_x + 5);
+    }
+
+    // A disk cache hit hard-links the target to the entry and to every file
+    //  with the same content; rewriting the target must not reach them.
+    void testCacheHitThenRewrite()
+    {
+        std::string const cache_directory = directory + "/cache";
+        mkdir(cache_directory.c_str(), 0755);
+        RenderCache cache(cache_directory, 0);
+        Layout layout(Dimensions(100, 100));
+
+        Document first(directory + "/c1.svg", layout);
+        first << Circle(Point(50, 50), 20, Fill(Color::Red));
+        CHECK(first.save(cache));
+        std::string const original = first.toString();
+
+        Document second(directory + "/c2.svg", layout);
+        second << Circle(Point(50, 50), 20, Fill(Color::Red));
+        CHECK(second.save(cache));
+        CHECK(cache.hits() == 1);
+
+        second << Rectangle(Point(0, 100), 10, 10, Fill(Color::Blue));
+        CHECK(second.save());
+        CHECK(readFile(directory + "/c1.svg") == original);
+        CHECK(readFile(directory + "/c2.svg") == second.toString());
+
+        Document third(directory + "/c3.svg", layout);
+        third << Rectangle(Point(0, 100), 10, 10, Fill(Color::Blue));
+        CHECK(third.saveAsync().get());
+        CHECK(readFile(directory + "/c1.svg") == original);
+
+        // The entry itself still serves the original content.
+        Document fourth(directory + "/c4.svg", layout);
+        fourth << Circle(Point(50, 50), 20, Fill(Color::Red));
+        CHECK(fourth.save(cache));
+        CHECK(cache.hits() == 2);
+        CHECK(readFile(directory + "/c4.svg") == original);
+    }
+}
+
+int main()
+{
+    char path[] = "/tmp/simple_svg_hpp_test_XXXXXX";
+    if (!mkdtemp(path)) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+    directory = path;
+
+    testMinifierOutputIsWellFormed();
+    testMinifierPiecesMatchWholeInput();
+    testMinifierKeepsMeaningfulDefaults();
+    testMinifiedImage();
+    testBase64();
+    testPngRoundTrip();
+    testCsv();
+    testCacheHitThenRewrite();
+    testCacheInMemory();
+    testAnimation();
+
+    std::string const remove = "rm -rf " + directory;
+    if (std::system(remove.c_str()) != 0)
+        std::fprintf(stderr, "could not remove %s\n", directory.c_str());
+    if (failures) {
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("all tests passed\n");
+    return 0;
+}
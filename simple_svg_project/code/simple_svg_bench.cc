@@ -0,0 +1,210 @@
+/**
+ *\file simple_svg_bench.cc
+ *\brief 多线程渲染的扩展性测试
+ *
+ *	用 1..N 个线程渲染同样数量的svg文档，输出每秒生成的图片数，用于估算渲染机器的规模
+ *
+ *	<code>
+ *	用法：simple_svg_bench [文档数] [最大线程数] [每个文档的图形数]
+ *	</code>
+ *
+ *\date 2017/07/17
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <libxml/tree.h>
+#include <libxml/parser.h>
+
+#include "simple_svg.h"
+
+/**
+ *\struct st_bench_task
+ *\brief 单个工作线程的任务
+ */
+typedef struct bench_task{
+
+	unsigned int	documents;	///< 本线程需要渲染的文档数
+	unsigned int	shapes;		///< 每个文档的图形数
+	unsigned long	bytes;		///< 本线程生成的字节数
+	int				ret;		///< SVG_SUCCESS 或 SVG_FAILED
+}st_bench_task;
+
+/**
+ *\brief 在句柄中绘制 shapes 条折线
+ */
+static void bench_draw(st_svg_handler *handler, unsigned int seed, unsigned int shapes)
+{
+	st_svg_position position = {0, 0, 800, 600, 0, 0, 800, 600};
+	xmlNodePtr node;
+	char buf[32];
+	unsigned int i;
+
+	set_svg_position(handler, &position);
+	for (i = 0; i < shapes; i++){
+
+		node = xmlNewTextChild(handler->root_node, NULL, BAD_CAST"line", NULL);
+		snprintf(buf, sizeof(buf), "%u", (seed + i) % 800);
+		xmlNewProp(node, BAD_CAST"x1", BAD_CAST buf);
+		snprintf(buf, sizeof(buf), "%u", (seed * 7 + i) % 600);
+		xmlNewProp(node, BAD_CAST"y1", BAD_CAST buf);
+		snprintf(buf, sizeof(buf), "%u", (seed + i * 3) % 800);
+		xmlNewProp(node, BAD_CAST"x2", BAD_CAST buf);
+		snprintf(buf, sizeof(buf), "%u", (seed * 5 + i * 11) % 600);
+		xmlNewProp(node, BAD_CAST"y2", BAD_CAST buf);
+		xmlNewProp(node, BAD_CAST"style", BAD_CAST"stroke: red; fill: none;");
+	}
+}
+
+/**
+ *\brief 工作线程入口
+ */
+static void *bench_worker(void *arg)
+{
+	st_bench_task *task = (st_bench_task *)arg;
+	st_svg_handler_pool *pool;
+	st_svg_handler *handler;
+	st_svg_buffer buffer = {NULL, 0, 0};
+	unsigned int i;
+
+	task->ret = SVG_FAILED;
+	pool = svg_thread_handler_pool();
+	if (NULL == pool){
+
+		return NULL;
+	}
+
+	for (i = 0; i < task->documents; i++){
+
+		handler = acquire_svg_handler(pool);
+		if (NULL == handler){
+
+			free_svg_buffer(&buffer);
+			return NULL;
+		}
+		bench_draw(handler, i, task->shapes);
+		if (SVG_SUCCESS != save_svg_to_buffer(handler, &buffer)){
+
+			release_svg_handler(pool, handler);
+			free_svg_buffer(&buffer);
+			return NULL;
+		}
+		task->bytes += buffer.size;
+		release_svg_handler(pool, handler);
+	}
+
+	free_svg_buffer(&buffer);
+	task->ret = SVG_SUCCESS;
+	return NULL;
+}
+
+/**
+ *\brief 用 threads 个线程渲染 documents 个文档
+ *\return 耗时（秒），失败时返回负数
+ */
+static double bench_run(unsigned int documents, unsigned int threads, unsigned int shapes,
+	unsigned long *bytes)
+{
+	pthread_t *tids;
+	st_bench_task *tasks;
+	struct timespec begin, end;
+	unsigned int i;
+	int failed = 0;
+
+	tids = (pthread_t *)calloc(threads, sizeof(pthread_t));
+	tasks = (st_bench_task *)calloc(threads, sizeof(st_bench_task));
+	if (NULL == tids || NULL == tasks){
+
+		free(tids);
+		free(tasks);
+		return -1;
+	}
+
+	for (i = 0; i < threads; i++){
+
+		tasks[i].documents = documents / threads + (i < documents % threads ? 1 : 0);
+		tasks[i].shapes = shapes;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for (i = 0; i < threads; i++){
+
+		if (0 != pthread_create(&tids[i], NULL, bench_worker, &tasks[i])){
+
+			threads = i;
+			failed = 1;
+			break;
+		}
+	}
+	*bytes = 0;
+	for (i = 0; i < threads; i++){
+
+		pthread_join(tids[i], NULL);
+		*bytes += tasks[i].bytes;
+		failed |= (SVG_SUCCESS != tasks[i].ret);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	free(tids);
+	free(tasks);
+	if (failed){
+
+		return -1;
+	}
+
+	return (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int documents = 2000;
+	unsigned int max_threads = (unsigned int)sysconf(_SC_NPROCESSORS_ONLN);
+	unsigned int shapes = 200;
+	unsigned int threads;
+	unsigned long bytes;
+	double seconds, base = 0;
+
+	if (argc > 1){
+
+		documents = (unsigned int)strtoul(argv[1], NULL, 10);
+	}
+	if (argc > 2){
+
+		max_threads = (unsigned int)strtoul(argv[2], NULL, 10);
+	}
+	if (argc > 3){
+
+		shapes = (unsigned int)strtoul(argv[3], NULL, 10);
+	}
+	if (0 == documents || 0 == max_threads){
+
+		fprintf(stderr, "usage: %s [documents] [max_threads] [shapes]\n", argv[0]);
+		return -1;
+	}
+
+	/* 创建任何线程之前，先在主线程完成 libxml2 的初始化 */
+	svg_global_init();
+
+	printf("documents=%u shapes=%u\n", documents, shapes);
+	printf("%8s %12s %12s %10s\n", "threads", "images/sec", "MB/sec", "speedup");
+	for (threads = 1; threads <= max_threads; threads++){
+
+		seconds = bench_run(documents, threads, shapes, &bytes);
+		if (seconds < 0){
+
+			fprintf(stderr, "bench failed with %u threads\n", threads);
+			return -1;
+		}
+		if (1 == threads){
+
+			base = seconds;
+		}
+		printf("%8u %12.1f %12.2f %9.2fx\n", threads, documents / seconds,
+			bytes / seconds / (1024 * 1024), base / seconds);
+	}
+
+	xmlCleanupParser();
+	return 0;
+}
@@ -0,0 +1,196 @@
+/**
+ *\file simple_svg_test.cc
+ *\brief 句柄池与模板修补的回归测试
+ *
+ *	<code>
+ *	用法：make test && ./simple_svg_test
+ *	</code>
+ *
+ *\date 2017/07/17
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <libxml/tree.h>
+#include <libxml/parser.h>
+
+#include "simple_svg.h"
+
+static int failures = 0;
+
+/**
+ *\brief 检查条件，失败时打印所在行
+ */
+#define CHECK(cond)	do{ if (!(cond)){ fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); failures++; } }while(0)
+
+/**
+ *\brief 把句柄序列化为以 '\0' 结尾的字符串，保存到 out
+ */
+static void test_save(st_svg_handler *handler, char *out, size_t size)
+{
+	st_svg_buffer buffer = {NULL, 0, 0};
+	size_t n;
+
+	out[0] = '\0';
+	if (SVG_SUCCESS == save_svg_to_buffer(handler, &buffer)){
+
+		n = buffer.size < size - 1 ? buffer.size : size - 1;
+		memcpy(out, buffer.data, n);
+		out[n] = '\0';
+	}
+	free_svg_buffer(&buffer);
+}
+
+/**
+ *\brief 修补祖先元素的文本后，被删除的后代 id 不能再定位到其他节点
+ */
+static void test_nested_ids(void)
+{
+	static const char content[] =
+		"<svg xmlns='http://www.w3.org/2000/svg'>"
+		"<g id='g'><text id='t'>old</text></g>"
+		"<g><rect id='r' x='1'/><text id='u'>keep</text></g>"
+		"</svg>";
+	char path[] = "/tmp/simple_svg_test_XXXXXX";
+	st_svg_template tpl;
+	st_svg_handler handler;
+	char out[1024];
+	int fd;
+
+	fd = mkstemp(path);
+	CHECK(fd >= 0);
+	if (fd < 0){
+
+		return;
+	}
+	CHECK((ssize_t)(sizeof(content) - 1) == write(fd, content, sizeof(content) - 1));
+	close(fd);
+
+	CHECK(SVG_SUCCESS == load_svg_template(&tpl, path));
+	unlink(path);
+	CHECK(SVG_SUCCESS == init_svg_handler(&handler));
+	CHECK(SVG_SUCCESS == clone_svg_template(&tpl, &handler));
+
+	/* 修补 g 的文本会删除 t，之后修补 t 必须失败，g 保持不变 */
+	CHECK(SVG_SUCCESS == patch_svg_text(&tpl, &handler, "g", "y"));
+	CHECK(SVG_FAILED == patch_svg_text(&tpl, &handler, "t", "z"));
+	CHECK(SVG_FAILED == patch_svg_attr(&tpl, &handler, "t", "x", "1"));
+
+	/* 兄弟子树中的 id 不受影响 */
+	CHECK(SVG_SUCCESS == patch_svg_attr(&tpl, &handler, "r", "x", "2"));
+	CHECK(SVG_SUCCESS == patch_svg_text(&tpl, &handler, "u", "a<b"));
+
+	/* 修改 id 后按新 id 定位 */
+	CHECK(SVG_SUCCESS == patch_svg_attr(&tpl, &handler, "r", "id", "r2"));
+	CHECK(SVG_FAILED == patch_svg_attr(&tpl, &handler, "r", "y", "3"));
+	CHECK(SVG_SUCCESS == patch_svg_attr(&tpl, &handler, "r2", "y", "3"));
+
+	test_save(&handler, out, sizeof(out));
+	CHECK(NULL != strstr(out, "<g id=\"g\">y</g>"));
+	CHECK(NULL != strstr(out, "<rect id=\"r2\" x=\"2\" y=\"3\"/>"));
+	CHECK(NULL != strstr(out, "<text id=\"u\">a&lt;b</text>"));
+
+	/* 重新克隆后索引恢复 */
+	CHECK(SVG_SUCCESS == clone_svg_template(&tpl, &handler));
+	CHECK(SVG_SUCCESS == patch_svg_text(&tpl, &handler, "t", "z"));
+	test_save(&handler, out, sizeof(out));
+	CHECK(NULL != strstr(out, "<g id=\"g\"><text id=\"t\">z</text></g>"));
+
+	/* reset 之后没有可修补的 id */
+	CHECK(SVG_SUCCESS == reset_svg_handler(&handler));
+	CHECK(SVG_FAILED == patch_svg_text(&tpl, &handler, "g", "y"));
+
+	destroy_svg_handler(&handler);
+	destroy_svg_template(&tpl);
+}
+
+/**
+ *\brief 重复归还同一个句柄必须失败，之后不会取出同一个句柄两次
+ */
+static void test_double_release(void)
+{
+	st_svg_handler_pool pool;
+	st_svg_handler *a, *b, *c;
+
+	CHECK(SVG_SUCCESS == init_svg_handler_pool(&pool, 2));
+	a = acquire_svg_handler(&pool);
+	b = acquire_svg_handler(&pool);
+	CHECK(NULL != a && NULL != b && a != b);
+	CHECK(SVG_SUCCESS == release_svg_handler(&pool, a));
+	CHECK(SVG_FAILED == release_svg_handler(&pool, a));
+	c = acquire_svg_handler(&pool);
+	CHECK(a == c);
+	CHECK(NULL == acquire_svg_handler(&pool));
+	CHECK(SVG_SUCCESS == release_svg_handler(&pool, b));
+	CHECK(SVG_SUCCESS == release_svg_handler(&pool, c));
+	destroy_svg_handler_pool(&pool);
+}
+
+/**
+ *\brief 克隆过模板的池句柄归还后再取出，根节点应恢复为 init 时的 <svg>
+ */
+static void test_release_after_clone(void)
+{
+	static const char content[] =
+		"<svg xmlns='http://www.w3.org/2000/svg' xmlns:ev='http://www.w3.org/2001/xml-events'"
+		" width='10' height='20' viewBox='0 0 10 20' id='root'><text id='t'>a</text></svg>";
+	char path[] = "/tmp/simple_svg_test_XXXXXX";
+	st_svg_handler_pool pool;
+	st_svg_template tpl;
+	st_svg_handler *handler;
+	st_svg_position position = {0, 0, 800, 600, 0, 0, 800, 600};
+	char out[1024];
+	int fd;
+
+	fd = mkstemp(path);
+	CHECK(fd >= 0);
+	if (fd < 0){
+
+		return;
+	}
+	CHECK((ssize_t)(sizeof(content) - 1) == write(fd, content, sizeof(content) - 1));
+	close(fd);
+	CHECK(SVG_SUCCESS == load_svg_template(&tpl, path));
+	unlink(path);
+
+	CHECK(SVG_SUCCESS == init_svg_handler_pool(&pool, 1));
+	handler = acquire_svg_handler(&pool);
+	CHECK(NULL != handler);
+	CHECK(SVG_SUCCESS == clone_svg_template(&tpl, handler));
+	CHECK(SVG_SUCCESS == release_svg_handler(&pool, handler));
+
+	handler = acquire_svg_handler(&pool);
+	CHECK(NULL != handler);
+	CHECK(handler->root_node == xmlDocGetRootElement(handler->xml_doc));
+	CHECK(NULL == handler->root_node->children);
+	CHECK(NULL == handler->root_node->nsDef);
+	CHECK(NULL == xmlHasProp(handler->root_node, BAD_CAST"id"));
+	CHECK(NULL == xmlHasProp(handler->root_node, BAD_CAST"viewBox"));
+	CHECK(SVG_SUCCESS == set_svg_position(handler, &position));
+	test_save(handler, out, sizeof(out));
+	CHECK(NULL != strstr(out, "<svg xmlns=\"http://www.w3.org/2000/svg\" xmlns:xlink=\"http://www.w3.org/1999/xlink\""
+		" version=\"1.1\" x=\"0\" y=\"0\" width=\"800\" height=\"600\" viewBox=\"0 0 800 600\"/>"));
+	CHECK(NULL == strstr(out, "xml-events"));
+
+	CHECK(SVG_SUCCESS == release_svg_handler(&pool, handler));
+	destroy_svg_handler_pool(&pool);
+	destroy_svg_template(&tpl);
+}
+
+int main(void)
+{
+	svg_global_init();
+
+	test_double_release();
+	test_nested_ids();
+	test_release_after_clone();
+
+	xmlCleanupParser();
+	if (failures){
+
+		fprintf(stderr, "%d check(s) failed\n", failures);
+		return 1;
+	}
+	printf("all tests passed\n");
+	return 0;
+}